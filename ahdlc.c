@@ -124,19 +124,22 @@ struct mbuf *
 ahdlctx(bp)
 struct mbuf *bp;
 {
-	struct mbuf *obp;
-	uint8 *cp;
-	int c;
+	struct mbuf *obp,*bp1;
+	uint8 *cp,*ip;
+	uint16 cnt;
 	uint16 fcs;
 
 	fcs = FCS_START;
 	obp = ambufw(5+2*len_p(bp));	/* Allocate worst-case */
 	cp = obp->data;
-	while((c = PULLCHAR(&bp)) != -1){
-		fcs = FCS(fcs,c);
-		cp = putbyte(cp,c);
+	/* Work directly on each segment rather than pulling a byte at a time */
+	for(bp1 = bp;bp1 != NULL;bp1 = bp1->next){
+		for(ip = bp1->data,cnt = bp1->cnt;cnt != 0;ip++,cnt--){
+			fcs = FCS(fcs,*ip);
+			cp = putbyte(cp,*ip);
+		}
 	}
-	free_p(&bp);	/* Shouldn't be necessary */
+	free_p(&bp);
 	fcs ^= 0xffff;
 	cp = putbyte(cp,fcs);
 	cp = putbyte(cp,fcs >> 8);
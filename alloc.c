@@ -15,6 +15,12 @@
 #include "proc.h"
 #include "cmdparse.h"
 
+#ifdef	MEMPROF
+/* We define the real ones */
+#undef	mallocw
+#undef	callocw
+#endif
+
 static unsigned long Memfail;	/* Count of allocation failures */
 static unsigned long Allocs;	/* Total allocations */
 static unsigned long Frees;	/* Total frees */
@@ -37,10 +43,16 @@ static int dostat(int argc,char *argv[],void *p);
 static int dofreelist(int argc,char *argv[],void *p);
 static int dothresh(int argc,char *argv[],void *p);
 static int dosizes(int argc,char *argv[],void *p);
+#ifdef	MEMPROF
+static int doprofile(int argc,char *argv[],void *p);
+#endif
 
 struct cmds Memcmds[] = {
 	"debug",	domdebug,	0, 0, NULL,
 	"freelist",	dofreelist,	0, 0, NULL,
+#ifdef	MEMPROF
+	"profile",	doprofile,	0, 0, NULL,
+#endif
 	"sizes",	dosizes,	0, 0, NULL,
 	"status",	dostat,		0, 0, NULL,
 	"thresh",	dothresh,	0, 0, NULL,
@@ -67,11 +79,58 @@ typedef union header HEADER;
 #define	BTOU(nb)	((((nb) + ABLKSIZE - 1) / ABLKSIZE) + 1)
 
 static HEADER HUGE *morecore(unsigned nu);
+static HEADER HUGE *getblock(unsigned nu,int i_state);
+static void putblock(HEADER HUGE *p);
+static void qflush(void);
 
 static HEADER Base;
 static HEADER HUGE *Allocp = NULL;
 static unsigned long Heapsize;
 
+/* Small blocks are kept on "quick lists", one for each exact size up to
+ * NQUICK units (header included), so both allocating and freeing them
+ * take constant time. An empty quick list is refilled by carving QBATCH
+ * blocks at once out of a single chunk of the main free list. Freed
+ * small blocks aren't coalesced until the quick lists are flushed back
+ * to the main list, which happens before the heap is grown and on red
+ * alert garbage collections; a refill never grows the heap by itself.
+ * Only larger blocks go through the address-ordered main list with its
+ * first-fit search.
+ */
+#define	NQUICK	33		/* Largest quick list block, units (256 bytes) */
+#define	QBATCH	8		/* Blocks carved per quick list refill */
+static HEADER HUGE *Quick[NQUICK+1];	/* Indexed by block size in units */
+static unsigned long Quickfree;	/* Units held on quick lists */
+static unsigned long Quickhits;	/* Allocations from quick lists */
+static unsigned long Qflushes;	/* Quick list flushes */
+static unsigned long Searches;	/* Main free list searches */
+static unsigned long Searchlen;	/* Total entries examined by them */
+
+#ifdef	MEMPROF
+/* Allocation site profiling. A block allocated through mallocw_site() or
+ * callocw_site() has an extra unit just after its header; the "size"
+ * field of that unit holds PROFMAGIC and the "ptr" field points to the
+ * entry in the site table, so free() can charge the block back to it.
+ * A real header always points to itself, which tells the two apart.
+ */
+#define	NSITES		128		/* Entries in site table */
+#define	PROFMAGIC	0x50524f46L	/* "PROF" */
+
+struct site {
+	char *file;		/* Source file of allocating call */
+	int line;		/* Line number of same */
+	unsigned long live;	/* Bytes currently allocated */
+	unsigned long allocs;	/* Total allocations */
+	unsigned long frees;	/* Total frees */
+	unsigned long lastallocs;	/* Value of allocs at last display */
+};
+static struct site Sites[NSITES];
+static unsigned long Untracked;	/* Allocations with no room in table */
+static int32 Proftime;		/* Time of last profile display */
+
+static struct site *findsite(char *file,int line);
+static void *unprofile(void *blk);
+#endif
 
 /* Memory blocks obtained from MS-DOS by allocmem() call */
 struct sysblock {
@@ -103,13 +162,76 @@ size_t nb;
 	nu = BTOU(nb);
 
 	i_state = dirps();
+	if(nu <= NQUICK){
+		if((p = Quick[nu]) == NULL
+		 && (p = getblock(nu*QBATCH,0)) != NULL){
+			/* Carve the new chunk into a batch of blocks,
+			 * keeping the first (and any odd unit) for ourselves
+			 */
+			while(p->s.size >= 2*nu){
+				p->s.size -= nu;
+				q = p + p->s.size;
+				q->s.size = nu;
+				q->s.ptr = Quick[nu];
+				Quick[nu] = q;
+				Quickfree += nu;
+				Availmem += nu;
+			}
+		} else if(p != NULL){
+			Quick[nu] = p->s.ptr;
+			Quickfree -= nu;
+			Availmem -= nu;
+			Quickhits++;
+		}
+	} else
+		p = NULL;
+	if(p == NULL && (p = getblock(nu,0)) == NULL){
+		/* Coalesce the quick lists before growing the heap */
+		if(Quickfree != 0)
+			qflush();
+		p = getblock(nu,i_state);
+	}
+	if(p != NULL){
+		p->s.ptr = p;	/* for auditing */
+		p++;
+	} else
+		Memfail++;
+	restore(i_state);
+#ifdef	LARGEDATA
+	/* On the brain-damaged Intel CPUs in "large data" model,
+	 * make sure the pointer's offset field isn't null
+	 * (unless the entire pointer is null).
+	 * The Turbo C compiler and certain
+	 * library functions like strrchr() assume this.
+	 */
+	if(FP_OFF(p) == 0 && FP_SEG(p) != 0){
+		/* Return denormalized but equivalent pointer */
+		return (void *)MK_FP(FP_SEG(p)-1,16);
+	}
+#endif
+	return (void *)p;
+}
+/* Take a block of 'nu' units off the main free list, first fit.
+ * Called with interrupts disabled; i_state is the caller's interrupt
+ * state, since we can't get more core from the system at interrupt level.
+ * Returns a pointer to the block's header, or NULL.
+ */
+static HEADER HUGE *
+getblock(nu,i_state)
+unsigned nu;
+int i_state;
+{
+	register HEADER HUGE *p, HUGE *q;
+
 	/* Initialize heap pointers if necessary */
 	if((q = Allocp) == NULL){
 		Base.s.ptr = Allocp = q = &Base;
 		Base.s.size = 1;
 	}
+	Searches++;
 	/* Search heap list */
 	for(p = q->s.ptr; ; q = p, p = p->s.ptr){
+		Searchlen++;
 		if(p->s.size >= nu){
 			/* This chunk is at least as large as we need */
 			if(p->s.size <= nu + 1){
@@ -129,35 +251,16 @@ size_t nb;
 #ifdef	circular
 			Allocp = q;
 #endif
-			p->s.ptr = p;	/* for auditing */
 			Availmem -= p->s.size;
-			p++;
-			break;
+			return p;
 		}
 		/* We've searched all the way around the list without
 		 * finding anything. Try to get more core from the system,
 		 * unless we're in an interrupt handler
 		 */
-		if(p == Allocp && (!i_state || (p = morecore(nu)) == NULL)){
-			p = NULL;
-			Memfail++;
-			break;
-		}
+		if(p == Allocp && (!i_state || (p = morecore(nu)) == NULL))
+			return NULL;
 	}
-	restore(i_state);
-#ifdef	LARGEDATA
-	/* On the brain-damaged Intel CPUs in "large data" model,
-	 * make sure the pointer's offset field isn't null
-	 * (unless the entire pointer is null).
-	 * The Turbo C compiler and certain
-	 * library functions like strrchr() assume this.
-	 */
-	if(FP_OFF(p) == 0 && FP_SEG(p) != 0){
-		/* Return denormalized but equivalent pointer */
-		return (void *)MK_FP(FP_SEG(p)-1,16);
-	}
-#endif
-	return (void *)p;
 }
 /* Get more memory from the system and put it on the heap */
 static HEADER HUGE *
@@ -179,10 +282,9 @@ unsigned nu;
 	if((int)(cp = (char HUGE *)sbrk(size)) != -1){
 		up = (HEADER *)cp;
 		up->s.size = nu;
-		up->s.ptr = up;	/* satisfy audit */
-		free(up + 1);
+		Availmem += nu;
+		putblock(up);
 		Heapsize += size;
-		Frees--;	/* Nullify increment inside free() */
 		return Allocp;
 	}
 #ifndef	__GNUC__
@@ -219,10 +321,9 @@ unsigned nu;
 		/* Expand or create succeeded, add to heap */
 		up = (HEADER *)cp;
 		up->s.size = (npar*16)/ABLKSIZE;
-		up->s.ptr = up;	/* satisfy audit */
-		free(up + 1);
+		Availmem += up->s.size;
+		putblock(up);
 		Heapsize += npar*16;
-		Frees--;	/* Nullify increment inside free() */
 		return Allocp;
 	}
 #endif	/* __GNUC__ */
@@ -234,13 +335,16 @@ void
 free(blk)
 void *blk;
 {
-	register HEADER HUGE *p, HUGE *q;
+	register HEADER HUGE *p;
 	unsigned short HUGE *ptr;
 	int i_state;
 	int i;
 
 	if(blk == NULL)
 		return;		/* Required by ANSI */
+#ifdef	MEMPROF
+	blk = unprofile(blk);
+#endif
 	Frees++;
 	p = ((HEADER HUGE *)blk) - 1;
 	/* Audit check */
@@ -265,6 +369,30 @@ void *blk;
 		}
 	}
 	i_state = dirps();
+	if(p->s.size <= NQUICK){
+		/* Small block; just put it on its quick list */
+		p->s.ptr = Quick[(unsigned)p->s.size];
+		Quick[(unsigned)p->s.size] = p;
+		Quickfree += p->s.size;
+	} else
+		putblock(p);
+	restore(i_state);
+	if(Memwait != 0)
+		ksignal(&Memwait,0);
+}
+/* Insert a block into the address-ordered main free list, coalescing it
+ * with its neighbors. Called with interrupts disabled.
+ */
+static void
+putblock(p)
+register HEADER HUGE *p;
+{
+	register HEADER HUGE *q;
+
+	if(Allocp == NULL){
+		Base.s.ptr = Allocp = &Base;
+		Base.s.size = 1;
+	}
  	/* Search the free list looking for the right place to insert */
 	for(q = Allocp; !(p > q && p < q->s.ptr); q = q->s.ptr){
 		/* Highest address on circular list? */
@@ -296,9 +424,24 @@ void *blk;
 #ifdef	circular
 	Allocp = q;
 #endif
-	restore(i_state);
-	if(Memwait != 0)
-		ksignal(&Memwait,0);
+}
+/* Return everything on the quick lists to the main free list so it can
+ * be coalesced. Called with interrupts disabled.
+ */
+static void
+qflush()
+{
+	register HEADER HUGE *p;
+	int i;
+
+	Qflushes++;
+	for(i=1;i<=NQUICK;i++){
+		while((p = Quick[i]) != NULL){
+			Quick[i] = p->s.ptr;
+			putblock(p);
+		}
+	}
+	Quickfree = 0;
 }
 
 /* Move existing block to new area */
@@ -312,6 +455,13 @@ size_t size;
 	void *new;
 
 	hp = ((HEADER *)area) - 1;
+#ifdef	MEMPROF
+	if(hp->s.ptr != hp && hp->s.size == PROFMAGIC){
+		/* Skip the profile unit too */
+		hp--;
+		osize = (hp->s.size -2) * ABLKSIZE;
+	} else
+#endif
 	osize = (hp->s.size -1) * ABLKSIZE;
 
 	/* We must copy the block since freeing it may cause the heap
@@ -365,6 +515,98 @@ unsigned size;	/* Size of each element */
 	memset(cp,0,i);
 	return cp;
 }
+#ifdef	MEMPROF
+/* Profiling versions of mallocw() and callocw(), called through the
+ * macros in global.h
+ */
+void *
+mallocw_site(nb,file,line)
+size_t nb;
+char *file;
+int line;
+{
+	HEADER HUGE *p;
+	struct site *sp;
+	int i_state;
+
+	p = (HEADER HUGE *)mallocw(nb + ABLKSIZE);
+	i_state = dirps();
+	if((sp = findsite(file,line)) != NULL){
+		sp->live += (p[-1].s.size - 2) * ABLKSIZE;
+		sp->allocs++;
+	} else
+		Untracked++;
+	restore(i_state);
+	p->s.ptr = (HEADER HUGE *)sp;
+	p->s.size = PROFMAGIC;
+	return (void *)(p + 1);
+}
+void *
+callocw_site(nelem,size,file,line)
+unsigned nelem;
+unsigned size;
+char *file;
+int line;
+{
+	register unsigned i;
+	register char *cp;
+
+	i = nelem * size;
+	cp = mallocw_site(i,file,line);
+	memset(cp,0,i);
+	return cp;
+}
+/* Find or create the site table entry for an allocating call.
+ * Called with interrupts disabled. Returns NULL if the table is full.
+ */
+static struct site *
+findsite(file,line)
+char *file;
+int line;
+{
+	struct site *sp;
+	unsigned h,n;
+
+	h = ((unsigned)line ^ ((unsigned)file[0] << 8)) % NSITES;
+	for(n=0;n<NSITES;n++){
+		sp = &Sites[h];
+		if(sp->file == NULL){
+			sp->file = file;
+			sp->line = line;
+			return sp;
+		}
+		if(sp->line == line && strcmp(sp->file,file) == 0)
+			return sp;
+		if(++h == NSITES)
+			h = 0;
+	}
+	return NULL;
+}
+/* If a block being freed carries a profile unit, charge it back to its
+ * site and return the address the unit occupies, which is what malloc()
+ * actually returned. Otherwise return the block unchanged.
+ */
+static void *
+unprofile(blk)
+void *blk;
+{
+	HEADER HUGE *p;
+	struct site *sp;
+	int i_state;
+
+	p = ((HEADER HUGE *)blk) - 1;
+	if(p->s.ptr == p || p->s.size != PROFMAGIC || p[-1].s.ptr != &p[-1])
+		return blk;
+	i_state = dirps();
+	if((sp = (struct site *)p->s.ptr) != NULL){
+		sp->live -= (p[-1].s.size - 2) * ABLKSIZE;
+		sp->frees++;
+	}
+	restore(i_state);
+	p->s.size = 0;	/* Don't charge it twice */
+	return (void *)p;
+}
+#endif	/* MEMPROF */
 /* Return 0 if at least Memthresh memory is available. Return 1 if
  * less than Memthresh but more than Memthresh/2 is available; i.e.,
  * if a yellow garbage collection should be performed. Return 2 if
@@ -401,7 +643,23 @@ char *argv[];
 void *envp;
 {
 	struct sysblock *sp;
-	int i;
+	HEADER HUGE *p;
+	unsigned long mainfree = 0;
+	unsigned long largest = 0;
+	unsigned long nblocks = 0;
+	int i,i_state;
+
+	/* Survey the main free list for fragmentation */
+	i_state = dirps();
+	if(Allocp != NULL){
+		for(p = Base.s.ptr;p != (HEADER HUGE *)&Base;p = p->s.ptr){
+			mainfree += p->s.size;
+			if(p->s.size > largest)
+				largest = p->s.size;
+			nblocks++;
+		}
+	}
+	restore(i_state);
 
 	printf("heap size %lu avail %lu (%lu%%) morecores %lu\n",
 	 Heapsize,Availmem * ABLKSIZE,100L*Availmem*ABLKSIZE/Heapsize,
@@ -418,6 +676,14 @@ void *envp;
 	printf("allocs %lu frees %lu (diff %lu) alloc fails %lu invalid frees %lu\n",
 		Allocs,Frees,Allocs-Frees,Memfail,Invalid);
 	printf("garbage collections yellow %lu red %lu\n",Yellows,Reds);
+	printf("free list blocks %lu largest %lu fragmentation %lu%% avg search %lu.%02lu\n",
+	 nblocks,largest * ABLKSIZE,
+	 mainfree != 0 ? 100 - 100L*largest/mainfree : 0L,
+	 Searches != 0 ? Searchlen/Searches : 0L,
+	 Searches != 0 ? (100*Searchlen/Searches) % 100 : 0L);
+	printf("quick lists hold %lu hits %lu (%lu%%) flushes %lu\n",
+	 Quickfree * ABLKSIZE,Quickhits,
+	 Allocs != 0 ? 100*Quickhits/Allocs : 0L,Qflushes);
 	printf("\n");
 	mbufstat();
 	return 0;
@@ -460,6 +726,24 @@ void *envp;
 		} else
 			printf(" | ");
 	}
+	if(i != 0)
+		printf("\n");
+	/* Summarize the quick lists by block size */
+	i = 0;
+	for(j=1;j<=NQUICK;j++){
+		if(Quick[j] == NULL)
+			continue;
+		corrupt = 0;
+		for(p = Quick[j];p != NULL;p = p->s.ptr)
+			corrupt++;
+		printf("quick %4u: %5u",(j-1) * ABLKSIZE,corrupt);
+		if(++i == 4){
+			i = 0;
+			if(printf("\n") == EOF)
+				return 0;
+		} else
+			printf(" | ");
+	}
 	if(i != 0)
 		printf("\n");
 	return 0;
@@ -489,6 +773,54 @@ void *p;
 	return subcmd(Memcmds,argc,argv,p);
 }
 
+#ifdef	MEMPROF
+/* Show the allocation sites holding the most heap, largest first */
+static int
+doprofile(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct site *sp,*top;
+	char shown[NSITES];
+	int n = 10;
+	int i;
+	int32 now,interval;
+
+	if(argc > 1)
+		n = atoi(argv[1]);
+	now = secclock();
+	interval = now - Proftime;
+	memset(shown,0,sizeof(shown));
+	printf("    live    allocs     frees  allocs/s site\n");
+	while(n-- > 0){
+		/* Selection sort is fine for a table this small */
+		top = NULL;
+		for(i=0,sp=Sites;i<NSITES;i++,sp++){
+			if(sp->file == NULL || shown[i])
+				continue;
+			if(top == NULL || sp->live > top->live)
+				top = sp;
+		}
+		if(top == NULL)
+			break;
+		shown[top - Sites] = 1;
+		if(printf("%8lu %9lu %9lu %9lu %s:%d\n",top->live,top->allocs,
+		 top->frees,interval > 0 ?
+		 (top->allocs - top->lastallocs)/interval : 0L,
+		 top->file,top->line) == EOF)
+			break;
+	}
+	if(Untracked != 0)
+		printf("%lu allocations from sites not in table\n",Untracked);
+	/* Rates are measured from one display to the next */
+	for(i=0,sp=Sites;i<NSITES;i++,sp++)
+		sp->lastallocs = sp->allocs;
+	Proftime = now;
+	return 0;
+}
+#endif	/* MEMPROF */
+
 static int
 dothresh(argc,argv,p)
 int argc;
@@ -503,7 +835,7 @@ int argc;
 char *argv[];
 void *ptr;
 {
-	int prev,j,i_state;
+	int prev,i,j,i_state;
 	HEADER HUGE *p;
 
 	prev = Memdebug;
@@ -518,6 +850,13 @@ void *ptr;
 			memcpy(p[j].c,Debugpat,sizeof(Debugpat));
 		}
 	}
+	for(i=1;i<=NQUICK;i++){
+		for(p = Quick[i];p != NULL;p = p->s.ptr){
+			for(j=1;j<p->s.size;j++){
+				memcpy(p[j].c,Debugpat,sizeof(Debugpat));
+			}
+		}
+	}
 	restore(i_state);
 	return 0;
 }
@@ -531,6 +870,7 @@ void *v2;
 {
 	void (**fp)(int);
 	int red;
+	int i_state;
 
 	for(;;){
 		ppause(1000L);	/* Run every second */
@@ -549,6 +889,12 @@ void *v2;
 			Reds++;
 			break;
 		}
+		if(red){
+			/* Let the quick lists coalesce with the rest */
+			i_state = dirps();
+			qflush();
+			restore(i_state);
+		}
 		for(fp = Gcollect;*fp != NULL;fp++)
 			(**fp)(red);
 	}
@@ -225,6 +225,7 @@ int pub;			/* Publish this entry? */
 		/* Response has come in, update entry and run through queue */
 		ap->state = ARP_VALID;
 		set_timer(&ap->timer,ARPLIFE*1000L);
+		set_timer_slack(&ap->timer,10000L);
 		memcpy(ap->hw_addr,hw_addr,at->hwalen);
 		ap->pub = pub;
 		while((bp = dequeue(&ap->pending)) != NULL)
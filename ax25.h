@@ -24,6 +24,7 @@ extern char Ax25_eol[];
 #define	MAXDIGIS	7	/* Maximum number of digipeaters */
 #define	ALEN		6	/* Number of chars in callsign field */
 #define	AXALEN		7	/* Total AX.25 address length, including SSID */
+#define	AXHDRLEN	((2+MAXDIGIS)*AXALEN + 2)	/* Largest header with ctl, pid */
 #define	AXBUF		10	/* Buffer size for maximum-length ascii call */
 
 /* Bits within SSID field of AX.25 address */
@@ -223,6 +223,9 @@ int smtp0(int argc,char *argv[],void *p);
 /* In sockcmd.c: */
 int dosock(int argc,char *argv[],void *p);
 
+/* In sim.c: */
+int dosim(int argc,char *argv[],void *p);
+
 /* In stdio.c: */
 int dofiles(int argc,char *argv[],void *p);
 
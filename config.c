@@ -246,6 +246,9 @@ struct cmds Cmds[] = {
 	"rmdir",	dormd,		0, 2, "rmdir <directory>",
 	"route",	doroute,	0, 0, NULL,
 	"session",	dosession,	0, 0, NULL,
+#ifdef	SIM
+	"sim",		dosim,		0, 0, NULL,
+#endif
 #ifdef	IPSEC
 	"secure",	dosec,		0, 0, "secure [[add|delete] <host>]",
 #endif
@@ -652,25 +655,30 @@ struct iftype Iftypes[] = {
 	"None",		nu_send,	nu_output,	NULL,
 	NULL,		CL_NONE,	0,		ip_proc,
 	NULL,		ip_dump,	NULL,		NULL,
+	0,
 
 #ifdef	AX25
 	"AX25UI",	axui_send,	ax_output,	pax25,
 	setcall,	CL_AX25,	AXALEN,		ax_recv,
 	ax_forus,	ax25_dump,	NULL,		NULL,
+	AXHDRLEN,
 
 	"AX25I",	axi_send,	ax_output,	pax25,
 	setcall,	CL_AX25,	AXALEN,		ax_recv,
 	ax_forus,	ax25_dump,	NULL,		NULL,
+	AXHDRLEN,
 #endif	/* AX25 */
 
 #ifdef	KISS
 	"KISSUI",	axui_send,	ax_output,	pax25,
 	setcall,	CL_AX25,	AXALEN,		kiss_recv,
 	ki_forus,	ki_dump,	NULL,		NULL,
+	AXHDRLEN+1,
 
 	"KISSI",	axi_send,	ax_output,	pax25,
 	setcall,	CL_AX25,	AXALEN,		kiss_recv,
 	ki_forus,	ki_dump,	NULL,		NULL,
+	AXHDRLEN+1,
 #endif	/* KISS */
 
 #ifdef	SLIP
@@ -682,6 +690,7 @@ struct iftype Iftypes[] = {
 #else
 					NULL,		NULL,
 #endif
+	0,
 #endif	/* SLIP */
 
 #ifdef	VJCOMPRESS
@@ -693,6 +702,7 @@ struct iftype Iftypes[] = {
 #else
 					NULL,		NULL,
 #endif
+	0,
 #endif	/* VJCOMPRESS */
 
 #ifdef	ETHER
@@ -703,59 +713,69 @@ struct iftype Iftypes[] = {
 	"Ethernet",	enet_send,	enet_output,	pether,
 	NULL,		CL_ETHERNET,	EADDR_LEN,	eproc,
 	ether_forus,	ether_dump,	NULL,		NULL,
+	ETHERLEN,
 #endif	/* ETHER */
 
 #ifdef	NETROM
 	"NETROM",	nr_send,	NULL,		pax25,
 	setcall,	CL_NETROM,	AXALEN,		NULL,
 	NULL,		NULL,	NULL,		NULL,
+	NR3HLEN+NR4MINHDR+AXHDRLEN+1,
 #endif	/* NETROM */
 
 #ifdef	SLFP
 	"SLFP",		pk_send,	NULL,		NULL,
 	NULL,		CL_NONE,	0,		ip_proc,
 	NULL,		ip_dump,	NULL,		NULL,
+	0,
 #endif	/* SLFP */
 
 #ifdef	PPP
 	"PPP",		ppp_send,	ppp_output,	NULL,
 	NULL,		CL_PPP,		0,		ppp_proc,
 	NULL,		ppp_dump,	NULL,		NULL,
+	PPP_HDR_LEN,
 #endif	/* PPP */
 
 #ifdef	SPPP
 	"sppp",		sppp_send,	NULL,		NULL,
 	NULL,		CL_NONE,	0,		ip_proc,
 	NULL,		ip_dump,	NULL,		NULL,
+	0,
 #endif	/* SPPP */
 
 #ifdef	ARCNET
 	"Arcnet",	anet_send,	anet_output,	parc,
 	garc,		CL_ARCNET,	1,		aproc,
 	arc_forus,	arc_dump,	NULL,		NULL,
+	ARCLEN,
 #endif	/* ARCNET */
 
 #ifdef	QTSO
 	"QTSO",		qtso_send,	NULL,		NULL,
 	NULL,		CL_NONE,	0,		ip_proc,
 	NULL,		NULL,	NULL,		NULL,
+	0,
 #endif	/* QTSO */
 
 #ifdef	CDMA_DM
 	"CDMA",		rlp_send,	NULL,		NULL,
 	NULL,		CL_NONE,	0,		ip_proc,
 	NULL,		ip_dump,	dd_init,	dd_stat,
+	0,
 #endif
 
 #ifdef	DMLITE
 	"DMLITE",	rlp_send,	NULL,		NULL,
 	NULL,		CL_NONE,	0,		ip_proc,
 	NULL,		ip_dump,	dl_init,	dl_stat,
+	0,
 #endif
 
 	NULL,	NULL,		NULL,		NULL,
 	NULL,		-1,		0,		NULL,
 	NULL,		NULL,	NULL,		NULL,
+	0,
 };
 
 /* Asynchronous interface mode table */
@@ -834,17 +854,17 @@ rtype(uint16 c)
 
 /* daemons to be run at startup time */
 struct daemon Daemons[] = {
-	"killer",	512,	killer,
-	"gcollect",	256,	gcollect,
-	"timer",	1024,	timerproc,
-	"network",	1536,	network,
-	"keyboard",	250,	keyboard,
-	"random init",	650,	rand_init,
+	"killer",	512,	killer,		PRI_BG,
+	"gcollect",	256,	gcollect,	PRI_BG,
+	"timer",	1024,	timerproc,	PRI_NET,
+	"network",	1536,	network,	PRI_NET,
+	"keyboard",	250,	keyboard,	PRI_NORM,
+	"random init",	650,	rand_init,	PRI_BG,
 #ifdef	PHOTURIS
-	"keygen",	2048,	gendh,
-	"key mgmt",	2048,	phot_proc,
+	"keygen",	2048,	gendh,		PRI_BG,
+	"key mgmt",	2048,	phot_proc,	PRI_NORM,
 #endif
-	NULL,	0,	NULL
+	NULL,	0,	NULL,	0
 };
 
 /* Functions to be called on each clock tick */
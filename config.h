@@ -21,6 +21,7 @@
 #define	SCROLLBACK	1000	/* Default lines in session scrollback file */
 
 #undef	IPSEC		1	/* IP network layer security functions */
+#undef	SIM		1	/* Simulated path for loopback traffic */
 
 /* Software tuning parameters */
 #define	MTHRESH		8192	/* Default memory threshold */
@@ -5,6 +5,7 @@ struct daemon {
 	char *name;
 	unsigned stksize;
 	void (*fp)(int,void *,void *);
+	int pri;	/* Scheduling priority class, PRI_xxx */
 };
 extern struct daemon Daemons[];
 
@@ -2,6 +2,7 @@
  * Copyright 1991 Phil Karn, KA9Q
  */
 #include <stdio.h>
+#include <errno.h>
 #include "global.h"
 #include "mbuf.h"
 #include "socket.h"
@@ -26,7 +27,7 @@ enum verb_level verb;	/* Verbosity level */
 	long total = 0;
 	long hmark = 0;
 	char *buf;
-	int cnt;
+	long cnt;
 	char cmdbuf[50];
 
 	if(verb >= V_STAT){
@@ -43,6 +44,24 @@ enum verb_level verb;	/* Verbosity level */
 		fmode(network,STREAM_ASCII);
 		break;
 	}
+	if(mode != ASCII_TYPE){
+		/* The file buffers go onto the send queue as is */
+		while((cnt = fsplice(fp,network,(long)BUFSIZ)) > 0){
+			total += cnt;
+			while(verb == V_HASH && total >= hmark+1000){
+				putchar('#');
+				hmark += 1000;
+			}
+		}
+		if(cnt == 0 || total != 0 || errno != EINVAL){
+			if(cnt == -1)
+				total = -1;
+			if(verb == V_HASH)
+				putchar('\n');
+			return total;
+		}
+		/* Not a stream fsplice() can take; copy it below */
+	}
 	buf = mallocw(BUFSIZ);
 	for(;;){
 		if((cnt = fread(buf,1,BUFSIZ,fp)) == 0){
@@ -181,6 +181,17 @@ char *strdup(const char *);
 int urandom(unsigned int n);
 int wildmat(char *s,char *p,char **argv);
 
+#ifdef	MEMPROF
+/* Heap allocation site profiling (see "mem profile" in alloc.c).
+ * Each mallocw() and callocw() call records its source location
+ * with the block it allocates.
+ */
+void *mallocw_site(size_t nb,char *file,int line);
+void *callocw_site(unsigned nelem,unsigned size,char *file,int line);
+#define	mallocw(nb)		mallocw_site(nb,__FILE__,__LINE__)
+#define	callocw(nelem,size)	callocw_site(nelem,size,__FILE__,__LINE__)
+#endif
+
 #ifdef	AZTEC
 #define	rewind(fp)	fseek(fp,0L,0);
 #endif
@@ -142,6 +142,7 @@ if_tx(int dev,void *arg1,void *unused)
 	struct qhdr qhdr;
 
 	iface = arg1;
+	setpri(Curproc,PRI_NET);
 	for(;;){
 		while(iface->outq == NULL)
 			kwait(&iface->outq);
@@ -419,6 +420,9 @@ showiface(struct iface *ifp)
 	printf("\n");
 	printf("           recv: ip %lu tot %lu idle %s\n",
 	 ifp->iprecvcnt,ifp->rawrecvcnt,tformat(secclock() - ifp->lastrecv));
+	if(ifp->rxcache.hits + ifp->rxcache.misses != 0)
+		printf("           rx mbuf cache: hits %lu misses %lu\n",
+		 ifp->rxcache.hits,ifp->rxcache.misses);
 }
 
 /* Command to detach an interface */
@@ -474,6 +478,7 @@ if_detach(struct iface *ifp)
 	killproc(ifp->supv);
 
 	/* Free allocated memory associated with this interface */
+	free_mbcache(&ifp->rxcache);
 	if(ifp->name != NULL)
 		free(ifp->name);
 	if(ifp->hwaddr != NULL)
@@ -41,6 +41,7 @@ struct iftype {
 				/* Function to initialize demand dialing */
 	int (*dstat)(struct iface *);
 				/* Function to display dialer status */
+	uint16 hdrlen;		/* Most link header space needed, bytes */
 };
 extern struct iftype Iftypes[];
 
@@ -115,6 +116,8 @@ struct iface {
 	int32 rawrecvcnt;	/* Raw packets received */
 	int32 lastsent;		/* Clock time of last send */
 	int32 lastrecv;		/* Clock time of last receive */
+
+	struct mbcache rxcache;	/* Receive buffer cache */
 };
 extern struct iface *Ifaces;	/* Head of interface list */
 extern struct iface  Loopback;	/* Optional loopback interface */
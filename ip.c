@@ -21,6 +21,9 @@ static void freefrag(struct frag *fp);
 static struct reasm *lookup_reasm(struct ip *ip);
 static struct reasm *creat_reasm(struct ip *ip);
 static struct frag *newfrag(uint16 offset,uint16 last,struct mbuf **bpp);
+static int reasm_hash(int32 source,int32 dest,uint16 id,char protocol);
+static int reasm_evict(struct reasm *keep);
+static void reasm_bytes(struct reasm *rp,int32 delta);
 void ttldec(struct iface *ifp);
 
 struct mib_entry Ip_mib[20] = {
@@ -47,6 +50,13 @@ struct mib_entry Ip_mib[20] = {
 };
 
 struct reasm *Reasmq;
+static struct reasm *Reasmtail;	/* Oldest reassembly descriptor */
+static struct reasm *Reasmtab[REASMHASH];	/* Hash chains of same */
+int32 Reasmbytes;
+int32 Reasmmax = 32768L;
+int32 Reasmoverlaps;
+int32 Reasmevicts;
+int32 Reasmdrops;
 uint16 Id_cntr = 0;	/* Datagram serial number */
 static struct raw_ip *Raw_ip;
 int Ip_trace = 0;
@@ -214,6 +224,7 @@ struct mbuf **bpp	/* The fragment itself */
 	struct mbuf *tbp;
 	uint16 i;
 	uint16 last;		/* Index of first byte beyond fragment */
+	uint16 flen;
 
 	last = ip->offset + ip->length - (IPLEN + ip->optlen);
 
@@ -232,9 +243,17 @@ struct mbuf **bpp	/* The fragment itself */
 		if((rp = creat_reasm(ip)) == NULL){
 			/* No space for descriptor, drop fragment */
 			ipReasmFails++;
+			Reasmdrops++;
 			free_p(bpp);
 			return -1;
 		}
+	} else if(rp->nfrags >= REASMFRAGS){
+		/* Too many holes; this looks like a fragment flood */
+		free_reasm(rp);
+		ipReasmFails++;
+		Reasmdrops++;
+		free_p(bpp);
+		return -1;
 	}
 	/* Keep restarting timer as long as we keep getting fragments */
 	stop_timer(&rp->timer);
@@ -247,23 +266,40 @@ struct mbuf **bpp	/* The fragment itself */
 		rp->length = last;
 
 	/* Set nextfrag to the first fragment which begins after us,
-	 * and lastfrag to the last fragment which begins before us
+	 * and lastfrag to the last fragment which begins before us.
+	 * Fragments usually arrive in order, so try the end first.
 	 */
-	lastfrag = NULL;
-	for(nextfrag = rp->fraglist;nextfrag != NULL;nextfrag = nextfrag->next){
-		if(nextfrag->offset > ip->offset)
-			break;
-		lastfrag = nextfrag;
+	if((lastfrag = rp->fragtail) != NULL && lastfrag->offset <= ip->offset){
+		nextfrag = NULL;
+	} else {
+		lastfrag = NULL;
+		for(nextfrag = rp->fraglist;nextfrag != NULL;nextfrag = nextfrag->next){
+			if(nextfrag->offset > ip->offset)
+				break;
+			lastfrag = nextfrag;
+		}
 	}
 	/* Check for overlap with preceeding fragment */
 	if(lastfrag != NULL  && ip->offset < lastfrag->last){
 		/* Strip overlap from new fragment */
+		Reasmoverlaps++;
 		i = lastfrag->last - ip->offset;
 		pullup(bpp,NULL,i);
 		if(*bpp == NULL)
 			return -1;	/* Nothing left */
 		ip->offset += i;
 	}
+	/* Make room for what's left of the fragment by evicting the oldest
+	 * other datagrams; if that isn't enough, drop it
+	 */
+	flen = last - ip->offset;
+	while(Reasmbytes + flen > Reasmmax && reasm_evict(rp) == 0)
+		;
+	if(Reasmbytes + flen > Reasmmax){
+		Reasmdrops++;
+		free_p(bpp);
+		return -1;
+	}
 	/* Look for overlap with succeeding segments */
 	for(; nextfrag != NULL; nextfrag = tfp){
 		tfp = nextfrag->next;	/* save in case we delete fp */
@@ -273,19 +309,26 @@ struct mbuf **bpp	/* The fragment itself */
 		/* Trim the front of this entry; if nothing is
 		 * left, remove it.
 		 */
+		Reasmoverlaps++;
 		i = last - nextfrag->offset;
-		pullup(&nextfrag->buf,NULL,i);
-		if(nextfrag->buf == NULL){
+		if(i >= nextfrag->last - nextfrag->offset){
 			/* superseded; delete from list */
+			reasm_bytes(rp,-(int32)(nextfrag->last - nextfrag->offset));
 			if(nextfrag->prev != NULL)
 				nextfrag->prev->next = nextfrag->next;
 			else
 				rp->fraglist = nextfrag->next;
-			if(tfp->next != NULL)
+			if(nextfrag->next != NULL)
 				nextfrag->next->prev = nextfrag->prev;
+			else
+				rp->fragtail = nextfrag->prev;
+			rp->nfrags--;
 			freefrag(nextfrag);
-		} else
+		} else {
+			pullup(&nextfrag->buf,NULL,i);
+			reasm_bytes(rp,-(int32)i);
 			nextfrag->offset = last;
+		}
 	}
 	/* Lastfrag now points, as before, to the fragment before us;
 	 * nextfrag points at the next fragment. Check to see if we can
@@ -298,7 +341,10 @@ struct mbuf **bpp	/* The fragment itself */
 		i |= PREPEND;
 	switch(i){
 	case INSERT:	/* Insert new desc between lastfrag and nextfrag */
-		tfp = newfrag(ip->offset,last,bpp);
+		if((tfp = newfrag(ip->offset,last,bpp)) == NULL){
+			Reasmdrops++;
+			return -1;	/* newfrag freed it */
+		}
 		tfp->prev = lastfrag;
 		tfp->next = nextfrag;
 		if(lastfrag != NULL)
@@ -307,6 +353,9 @@ struct mbuf **bpp	/* The fragment itself */
 			rp->fraglist = tfp;	/* First on list */
 		if(nextfrag != NULL)
 			nextfrag->prev = tfp;
+		else
+			rp->fragtail = tfp;	/* Last on list */
+		rp->nfrags++;
 		break;
 	case APPEND:	/* Append to lastfrag */
 		append(&lastfrag->buf,bpp);
@@ -315,7 +364,7 @@ struct mbuf **bpp	/* The fragment itself */
 	case PREPEND:	/* Prepend to nextfrag */
 		tbp = nextfrag->buf;
 		nextfrag->buf = *bpp;
-		bpp = NULL;
+		*bpp = NULL;
 		append(&nextfrag->buf,&tbp);
 		nextfrag->offset = ip->offset;	/* Extend backward */
 		break;
@@ -332,9 +381,13 @@ struct mbuf **bpp	/* The fragment itself */
 		lastfrag->next = nextfrag->next;
 		if(nextfrag->next != NULL)
 			nextfrag->next->prev = lastfrag;
+		else
+			rp->fragtail = lastfrag;
+		rp->nfrags--;
 		freefrag(nextfrag);
 		break;
 	}
+	reasm_bytes(rp,(int32)flen);
 	if(rp->fraglist->offset == 0 && rp->fraglist->next == NULL 
 		&& rp->length != 0){
 
@@ -393,36 +446,44 @@ struct raw_ip *rpp
 	free(rp);
 }
 
+/* Hash a datagram's source, destination, id and protocol */
+static int
+reasm_hash(
+int32 source,
+int32 dest,
+uint16 id,
+char protocol
+){
+	register uint16 x;
+
+	x = hiword(source) ^ loword(source) ^ hiword(dest) ^ loword(dest)
+	 ^ id ^ (uint8)protocol;
+	x ^= x >> 8;
+	return x & (REASMHASH-1);
+}
 static struct reasm *
 lookup_reasm(
 struct ip *ip
 ){
 	register struct reasm *rp;
-	struct reasm *rplast = NULL;
 
-	for(rp = Reasmq;rp != NULL;rplast=rp,rp = rp->next){
+	for(rp = Reasmtab[reasm_hash(ip->source,ip->dest,ip->id,ip->protocol)];
+	 rp != NULL;rp = rp->hnext){
 		if(ip->id == rp->id && ip->source == rp->source
-		 && ip->dest == rp->dest && ip->protocol == rp->protocol){
-			if(rplast != NULL){
-				/* Move to top of list for speed */
-				rplast->next = rp->next;
-				rp->next = Reasmq;
-				Reasmq = rp;
-			}
+		 && ip->dest == rp->dest && ip->protocol == rp->protocol)
 			return rp;
-		}
-
 	}
 	return NULL;
 }
 /* Create a reassembly descriptor,
- * put at head of reassembly list
+ * put at head of reassembly list and its hash chain
  */
 static struct reasm *
 creat_reasm(
 struct ip *ip
 ){
 	register struct reasm *rp;
+	int i;
 
 	if((rp = (struct reasm *)calloc(1,sizeof(struct reasm))) == NULL)
 		return rp;	/* No space for descriptor */
@@ -431,35 +492,48 @@ struct ip *ip
 	rp->id = ip->id;
 	rp->protocol = ip->protocol;
 	set_timer(&rp->timer,ipReasmTimeout * 1000L);
+	set_timer_slack(&rp->timer,1000L);
 	rp->timer.func = ip_timeout;
 	rp->timer.arg = rp;
 
-	rp->next = Reasmq;
+	rp->prev = NULL;
+	if((rp->next = Reasmq) != NULL)
+		rp->next->prev = rp;
+	else
+		Reasmtail = rp;
 	Reasmq = rp;
+	i = reasm_hash(rp->source,rp->dest,rp->id,rp->protocol);
+	rp->hnext = Reasmtab[i];
+	Reasmtab[i] = rp;
 	return rp;
 }
 
 /* Free all resources associated with a reassembly descriptor */
 static void
 free_reasm(
-struct reasm *r
+struct reasm *rp
 ){
-	register struct reasm *rp;
-	struct reasm *rplast = NULL;
+	register struct reasm **rpp;
 	register struct frag *fp;
 
-	for(rp = Reasmq;rp != NULL;rplast = rp,rp=rp->next)
-		if(r == rp)
+	for(rpp = &Reasmtab[reasm_hash(rp->source,rp->dest,rp->id,rp->protocol)];
+	 *rpp != NULL;rpp = &(*rpp)->hnext)
+		if(*rpp == rp)
 			break;
-	if(rp == NULL)
+	if(*rpp == NULL)
 		return;	/* Not on list */
+	*rpp = rp->hnext;
 
 	stop_timer(&rp->timer);
 	/* Remove from list of reassembly descriptors */
-	if(rplast != NULL)
-		rplast->next = rp->next;
+	if(rp->prev != NULL)
+		rp->prev->next = rp->next;
 	else
 		Reasmq = rp->next;
+	if(rp->next != NULL)
+		rp->next->prev = rp->prev;
+	else
+		Reasmtail = rp->prev;
 
 	/* Free any fragments on list, starting at beginning */
 	while((fp = rp->fraglist) != NULL){
@@ -467,8 +541,36 @@ struct reasm *r
 		free_p(&fp->buf);
 		free(fp);
 	}
+	Reasmbytes -= rp->bytes;
 	free(rp);
 }
+/* Free the oldest reassembly descriptor other than the one given.
+ * Return -1 if there isn't one.
+ */
+static int
+reasm_evict(
+struct reasm *keep
+){
+	register struct reasm *rp;
+
+	for(rp = Reasmtail;rp != NULL && rp == keep;rp = rp->prev)
+		;
+	if(rp == NULL)
+		return -1;
+	free_reasm(rp);
+	ipReasmFails++;
+	Reasmevicts++;
+	return 0;
+}
+/* Account for a change in the data held by a reassembly descriptor */
+static void
+reasm_bytes(
+struct reasm *rp,
+int32 delta
+){
+	rp->bytes += (int)delta;
+	Reasmbytes += delta;
+}
 
 /* Handle reassembly timeouts by deleting all reassembly resources */
 static void
@@ -507,27 +609,27 @@ struct frag *fp
 	free(fp);
 }
 
-/* In red alert mode, blow away the whole reassembly queue. Otherwise crunch
+/* In red alert mode, evict the oldest datagrams being reassembled until
+ * they use no more than half of the reassembly budget. Otherwise crunch
  * each fragment on each reassembly descriptor
  */
 void
 ip_garbage(
 int red
 ){
-	struct reasm *rp,*rp1;
+	struct reasm *rp;
 	struct frag *fp;
 	struct raw_ip *rwp;
 	struct iface *ifp;
 
 	/* Run through the reassembly queue */
-	for(rp = Reasmq;rp != NULL;rp = rp1){
-		rp1 = rp->next;
-		if(red){
-			free_reasm(rp);
-		} else {
-			for(fp = rp->fraglist;fp != NULL;fp = fp->next){
+	if(red){
+		while(Reasmbytes > Reasmmax/2 && reasm_evict(NULL) == 0)
+			;
+	} else {
+		for(rp = Reasmq;rp != NULL;rp = rp->next){
+			for(fp = rp->fraglist;fp != NULL;fp = fp->next)
 				mbuf_crunch(&fp->buf);
-			}
 		}
 	}
 	/* Run through the raw IP queue */
@@ -559,10 +661,22 @@ struct iface *ifp
 	struct mbuf *bp,*bpprev,*bpnext;
 	struct qhdr qhdr;
 	struct ip ip;
+	uint8 *cp;
 
 	bpprev = NULL;
 	for(bp = ifp->outq; bp != NULL;bpprev = bp,bp = bpnext){
 		bpnext = bp->anext;
+		cp = bp->data + sizeof(qhdr);
+		if(bp->refcnt == 1 && bp->dup == NULL
+		 && bp->cnt >= sizeof(qhdr) + IPLEN && cp[8] > 1){
+			/* Decrement the TTL in place and adjust the header
+			 * checksum for it, leaving the packet on the queue
+			 */
+			put16(&cp[10],csum_adjust(get16(&cp[10]),get16(&cp[8]),
+			 get16(&cp[8]) - 0x100));
+			cp[8]--;
+			continue;
+		}
 		pullup(&bp,&qhdr,sizeof(qhdr));
 		ntohip(&ip,&bp);
 		if(--ip.ttl == 0){
@@ -111,28 +111,42 @@ struct route {
 	} flags;
 	struct timer timer;	/* Time until aging of this entry */
 	int32 uses;		/* Usage count */
+	struct tcp_cc *tcpcc;	/* TCP congestion control, NULL for default */
 };
 extern struct route *Routes[32][HASHMOD];	/* Routing table */
 extern struct route R_default;			/* Default route entry */
 
-/* Cache for the last-used routing entry, speeds up the common case where
+/* Cache of recently used routing entries, speeds up the common case where
  * we handle a burst of packets to the same destination
  */
+#define	RTCSETS	16		/* Sets in route cache, power of 2 */
+#define	RTCWAYS	4		/* Entries per set */
 struct rt_cache {
 	int32 target;
 	struct route *route;
+	int32 gen;		/* Value of Rtgen when entry was made */
 };
-extern struct rt_cache Rt_cache[];
+extern struct rt_cache Rt_cache[RTCSETS][RTCWAYS];
+extern int32 Rtgen;		/* Bumped on every routing table change */
 extern int32 Rtlookups;	/* Count of calls to rt_lookup() */
 extern int32 Rtchits;		/* Count of cache hits in rt_lookup() */
+extern int32 Rtcstale;		/* Cache misses on stale entries */
+extern int32 Rtcevicts[];	/* Valid cache entries evicted, per set */
+extern int32 Rtnodes;		/* Nodes in route lookup trie */
+extern int32 Rtroutes;		/* Routes in route lookup trie */
 
 extern uint16 Id_cntr;		/* Datagram serial number */
 
 /* Reassembly descriptor */
 struct reasm {
-	struct reasm *next;	/* Linked list pointer */
+	struct reasm *next;	/* Linked list pointers, newest first */
+	struct reasm *prev;
+	struct reasm *hnext;	/* Hash chain pointer */
 	struct timer timer;	/* Reassembly timeout timer */
 	struct frag *fraglist;	/* Head of data fragment chain */
+	struct frag *fragtail;	/* Last fragment on chain */
+	int nfrags;		/* Fragments on chain */
+	uint16 bytes;		/* Data bytes held in fragments */
 	uint16 length;		/* Entire datagram length, if known */
 	int32 source;		/* src/dest/id/protocol uniquely describe a datagram */
 	int32 dest;
@@ -150,6 +164,13 @@ struct frag {
 };
 
 extern struct reasm *Reasmq;	/* The list of reassembly descriptors */
+#define	REASMHASH	16	/* Reassembly hash chains, power of 2 */
+#define	REASMFRAGS	32	/* Max separate fragments per datagram */
+extern int32 Reasmbytes;	/* Fragment data held for reassembly */
+extern int32 Reasmmax;		/* Limit on same */
+extern int32 Reasmoverlaps;	/* Fragments overlapping others */
+extern int32 Reasmevicts;	/* Datagrams evicted to stay under Reasmmax */
+extern int32 Reasmdrops;	/* Fragments dropped for lack of space */
 
 /* Structure for handling raw IP user sockets */
 struct raw_ip {
@@ -205,18 +226,25 @@ struct route *rt_add(int32 target,unsigned int bits,int32 gateway,
 	struct iface *iface,int32 metric,int32 ttl,uint8 private);
 int rt_drop(int32 target,unsigned int bits);
 struct route *rt_lookup(int32 target);
+uint16 ip_hdrroom(int32 target);
 struct route *rt_blookup(int32 target,unsigned int bits);
 
 /* In iphdr.c: */
 uint16 cksum(struct pseudo_header *ph,struct mbuf *m,uint16 len);
+uint16 cksumcpy(struct pseudo_header *ph,struct mbuf *m,uint8 *buf,
+	uint16 len);
 uint16 eac(int32 sum);
+uint16 csum_adjust(uint16 checksum,uint16 old,uint16 new);
+uint16 csum_adjust32(uint16 checksum,int32 old,int32 new);
+uint16 csum_adjbytes(uint16 checksum,int off,uint8 *old,uint8 *new,int len);
 void htonip(struct ip *ip,struct mbuf **data,int cflag);
 int ntohip(struct ip *ip,struct mbuf **bpp);
 
 /* In either lcsum.c or pcgen.asm: */
 uint16 lcsum(uint16 *wp,uint16 len);
+uint16 lcsumcpy(uint16 *dst,uint16 *src,uint16 len);
 
 /* In sim.c: */
-void net_sim(struct mbuf *bp);
+void net_sim(struct mbuf **bpp);
 
 #endif /* _IP_H */
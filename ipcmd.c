@@ -12,15 +12,20 @@
 #include "cmdparse.h"
 #include "commands.h"
 #include "rip.h"
+#include "tcp.h"
 
 int32 Ip_addr;
 
 static int doadd(int argc,char *argv[],void *p);
+static int docsbench(int argc,char *argv[],void *p);
+static int dobench(int argc,char *argv[],void *p);
+static int dotcpcc(int argc,char *argv[],void *p);
 static int dodrop(int argc,char *argv[],void *p);
 static int doflush(int argc,char *argv[],void *p);
 static int doipaddr(int argc,char *argv[],void *p);
 static int doipstat(int argc,char *argv[],void *p);
 static int dolook(int argc,char *argv[],void *p);
+static int doreasmmax(int argc,char *argv[],void *p);
 static int dortimer(int argc,char *argv[],void *p);
 static int dottl(int argc,char *argv[],void *p);
 static int doiptrace(int argc,char *argv[],void *p);
@@ -28,6 +33,8 @@ static int dumproute(struct route *rp);
 
 static struct cmds Ipcmds[] = {
 	"address",	doipaddr,	0,	0, NULL,
+	"cksum",	docsbench,	0,	0, NULL,
+	"reasmmax",	doreasmmax,	0,	0, NULL,
 	"rtimer",	dortimer,	0,	0, NULL,
 	"status",	doipstat,	0,	0, NULL,
 	"trace",	doiptrace,	0,	0, NULL,
@@ -42,6 +49,12 @@ static struct cmds Rtcmds[] = {
 	"addprivate",	doadd,		0,	3,
 	"route addprivate <dest addr>[/<bits>] <if name> [gateway] [metric]",
 
+	"bench",	dobench,	0,	0,
+	NULL,
+
+	"cc",		dotcpcc,	0,	2,
+	"route cc <dest addr>[/<bits>] [<tcp cc>|default]",
+
 	"drop",		dodrop,		0,	2,
 	"route drop <dest addr>[/<bits>]",
 
@@ -97,6 +110,14 @@ void *p;
 	return setlong(&ipReasmTimeout,"IP reasm timeout (sec)",argc,argv);
 }
 static int
+doreasmmax(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Reasmmax,"IP reasm buffer limit (bytes)",argc,argv);
+}
+static int
 dottl(argc,argv,p)
 int argc;
 char *argv[];
@@ -200,6 +221,54 @@ void *p;
 		printf("Can't add route\n");
 	return 0;
 }
+/* Set the TCP congestion control module for connections that begin
+ * over a route
+ */
+static int
+dotcpcc(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	char *bitp;
+	unsigned bits;
+	int32 n;
+	struct route *rp;
+	struct tcp_cc *cc;
+
+	if(strcmp(argv[1],"default") == 0){
+		rp = &R_default;
+	} else {
+		if((bitp = strchr(argv[1],'/')) != NULL){
+			*bitp++ = '\0';
+			bits = atoi(bitp);
+		} else
+			bits = 32;
+		if((n = resolve(argv[1])) == 0){
+			printf(Badhost,argv[1]);
+			return 1;
+		}
+		n &= ~0L << (32-bits);
+		if((rp = rt_blookup(n,bits)) == NULL){
+			printf("No such route\n");
+			return 1;
+		}
+	}
+	if(argc < 3){
+		printf("%s\n",rp->tcpcc != NULL ? rp->tcpcc->name : "default");
+		return 0;
+	}
+	if(strcmp(argv[2],"default") == 0){
+		rp->tcpcc = NULL;
+		return 0;
+	}
+	if((cc = tcp_ccfind(argv[2])) == NULL){
+		printf("Unknown congestion control %s\n",argv[2]);
+		return 1;
+	}
+	rp->tcpcc = cc;
+	return 0;
+}
 /* Drop an entry from the routing table
  * E.g., "drop 128.96/16
  */
@@ -307,6 +376,104 @@ void *p;
 	dumproute(rp);
 	return 0;
 }
+/* Time checksums of small, medium and large mbuf chains, both alone
+ * and combined with copying the data out
+ */
+static int
+docsbench(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	static uint16 sizes[] = { 40, 576, 64000U };
+	struct mbuf *bp,*tail;
+	uint8 *buf;
+	int32 count,i,start,ms1,ms2;
+	uint16 size,cnt,total;
+	int j;
+
+	count = argc > 1 ? atol(argv[1]) : 20L;
+	if(count <= 0)
+		return 1;
+	buf = mallocw(sizes[2]);
+	for(j=0;j<3;j++){
+		/* Build a chain of up to 2000-byte mbufs */
+		size = sizes[j];
+		bp = tail = NULL;
+		for(total = 0;total < size;total += cnt){
+			cnt = min(size - total,2000);
+			if(bp == NULL)
+				bp = tail = ambufw(cnt);
+			else
+				tail = tail->next = ambufw(cnt);
+			memset(tail->data,total,cnt);
+			tail->cnt = cnt;
+		}
+		start = msclock();
+		for(i=0;i<count;i++)
+			cksum(NULL,bp,size);
+		ms1 = msclock() - start;
+		start = msclock();
+		for(i=0;i<count;i++)
+			cksumcpy(NULL,bp,buf,size);
+		ms2 = msclock() - start;
+		printf("%5u bytes: cksum %lu KB/s, cksumcpy %lu KB/s\n",size,
+		 ms1 != 0 ? count * size / ms1 : 0L,
+		 ms2 != 0 ? count * size / ms2 : 0L);
+		free_p(&bp);
+	}
+	free(buf);
+	return 0;
+}
+/* Time route lookups of random addresses against the current table.
+ * The cache and its statistics are put back afterwards, so the real
+ * working set and the "ip status" figures are left as they were.
+ */
+static int
+dobench(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	int32 count,i,start,elapsed,target;
+	int32 lookups,hits,stale;
+	int32 evicts[RTCSETS];
+	struct rt_cache *save;
+
+	count = argc > 1 ? atol(argv[1]) : 10000L;
+	if(count <= 0)
+		return 1;
+	save = (struct rt_cache *)mallocw(sizeof(Rt_cache));
+	memcpy(save,Rt_cache,sizeof(Rt_cache));
+	memcpy(evicts,Rtcevicts,sizeof(evicts));
+	lookups = Rtlookups;
+	hits = Rtchits;
+	stale = Rtcstale;
+	start = msclock();
+	for(i=0;i<count;i++){
+		/* rand() has only 15 bits; build the address bytewise */
+		target = rand() & 0xff;
+		target = (target << 8) | (rand() & 0xff);
+		target = (target << 8) | (rand() & 0xff);
+		target = (target << 8) | (rand() & 0xff);
+		rt_lookup(target);
+	}
+	elapsed = msclock() - start;
+	printf("%lu routes, %lu trie nodes: %lu lookups in %lu ms",
+	 Rtroutes,Rtnodes,count,elapsed);
+	if(elapsed != 0)
+		printf(", %lu/sec",count * 1000L / elapsed);
+	printf(" (%lu cache hits)\n",Rtchits - hits);
+
+	/* Don't skew the real cache or statistics */
+	memcpy(Rt_cache,save,sizeof(Rt_cache));
+	free(save);
+	memcpy(Rtcevicts,evicts,sizeof(evicts));
+	Rtlookups = lookups;
+	Rtchits = hits;
+	Rtcstale = stale;
+	return 0;
+}
 
 static int
 doipstat(argc,argv,p)
@@ -328,18 +495,25 @@ void *p;
 	}
 	if((i % 2) == 0)
 		printf("\n");
-	printf("Routing lookups: %lu, cache hits %lu (%lu%%)\n",
+	printf("Routing lookups: %lu, cache hits %lu (%lu%%) stale %lu\n",
 	 Rtlookups,Rtchits,
-	 Rtlookups != 0 ? (Rtchits*100 + Rtlookups/2)/Rtlookups: 0);
+	 Rtlookups != 0 ? (Rtchits*100 + Rtlookups/2)/Rtlookups: 0,
+	 Rtcstale);
+	printf("Route cache evictions by set:");
+	for(i=0;i<RTCSETS;i++)
+		printf(" %lu",Rtcevicts[i]);
+	printf("\n");
 
+	printf("Reassembly: %lu/%lu bytes, overlaps %lu evictions %lu drops %lu\n",
+	 Reasmbytes,Reasmmax,Reasmoverlaps,Reasmevicts,Reasmdrops);
 	if(Reasmq != NULL)
 		printf("Reassembly fragments:\n");
 	for(rp = Reasmq;rp != NULL;rp = rp->next){
 		printf("src %s",inet_ntoa(rp->source));
 		printf(" dest %s",inet_ntoa(rp->dest));
-		printf(" id %u pctl %u time %lu len %u\n",
+		printf(" id %u pctl %u time %lu len %u frags %d bytes %u\n",
 		 rp->id,rp->protocol,read_timer(&rp->timer),
-		 rp->length);
+		 rp->length,rp->nfrags,rp->bytes);
 		for(fp = rp->fraglist;fp != NULL;fp = fp->next){
 			printf(" offset %u last %u\n",fp->offset,
 			fp->last);
@@ -111,6 +111,78 @@ int32 sum	/* Carries in high order 16 bits */
 		sum = csum + (sum & 0xffffL);
 	return (uint16) (sum & 0xffffl);	/* Chops to 16 bits */
 }
+/* Update a checksum for a 16-bit word of the data changing from old to
+ * new, without recomputing it over all the data (RFC 1624, eqn 3):
+ * HC' = ~(~HC + ~m + m')
+ */
+uint16
+csum_adjust(
+uint16 checksum,
+uint16 old,
+uint16 new
+){
+	int32 sum;
+
+	sum = (uint16)~checksum;
+	sum += (uint16)~old;
+	sum += new;
+	return (uint16)(~eac(sum) & 0xffff);
+}
+/* Same, for a 32-bit field such as an IP address */
+uint16
+csum_adjust32(
+uint16 checksum,
+int32 old,
+int32 new
+){
+	checksum = csum_adjust(checksum,hiword(old),hiword(new));
+	return csum_adjust(checksum,loword(old),loword(new));
+}
+/* Same, for len bytes starting at byte offset off in the data, which
+ * need not be on a word boundary
+ */
+uint16
+csum_adjbytes(
+uint16 checksum,
+int off,
+uint8 *old,
+uint8 *new,
+int len
+){
+	int32 sum;
+	uint16 wold,wnew;
+
+	sum = (uint16)~checksum;
+	for(;len > 0;len--,off++){
+		wold = *old++;
+		wnew = *new++;
+		if((off & 1) == 0){
+			/* High byte of its word */
+			wold <<= 8;
+			wnew <<= 8;
+		}
+		sum += (uint16)~wold;
+		sum += wnew;
+	}
+	return (uint16)(~eac(sum) & 0xffff);
+}
+/* Sum the pseudo-header, if present */
+static int32
+phsum(
+struct pseudo_header *ph
+){
+	int32 sum;
+
+	if(ph == NULL)
+		return 0L;
+	sum = hiword(ph->source);
+	sum += loword(ph->source);
+	sum += hiword(ph->dest);
+	sum += loword(ph->dest);
+	sum += ph->protocol;
+	sum += ph->length;
+	return sum;
+}
 /* Checksum a mbuf chain, with optional pseudo-header */
 uint16
 cksum(
@@ -124,17 +196,9 @@ uint16 len
 	uint16 csum1;
 	int swap = 0;
 
-	sum = 0l;
-
 	/* Sum pseudo-header, if present */
-	if(ph != NULL){
-		sum = hiword(ph->source);
-		sum += loword(ph->source);
-		sum += hiword(ph->dest);
-		sum += loword(ph->dest);
-		sum += ph->protocol;
-		sum += ph->length;
-	}
+	sum = phsum(ph);
+
 	/* Now do each mbuf on the chain */
 	for(total = 0; m != NULL && total < len; m = m->next) {
 		cnt = min(m->cnt, len - total);
@@ -174,4 +238,47 @@ uint16 len
 	/* Do final end-around carry, complement and return */
 	return (uint16)(~eac(sum) & 0xffff);
 }
+/* Copy the first len bytes of a mbuf chain into a flat buffer, and return
+ * the same checksum as cksum() would, in a single pass over the data
+ */
+uint16
+cksumcpy(
+struct pseudo_header *ph,
+struct mbuf *m,
+uint8 *buf,
+uint16 len
+){
+	register uint16 cnt;
+	register int32 sum;
+	register uint8 *up;
+	uint16 total,n;
+	int odd = 0;	/* At an odd offset in the data */
 
+	sum = phsum(ph);
+	for(total = 0; m != NULL && total < len; m = m->next) {
+		cnt = min(m->cnt, len - total);
+		total += cnt;
+		up = m->data;
+		if(odd && cnt != 0){
+			/* Low byte of a word split across mbufs */
+			sum += *up;
+			*buf++ = *up++;
+			cnt--;
+			odd = 0;
+		}
+		if(cnt > 1){
+			sum += lcsumcpy((uint16 *)buf,(uint16 *)up,(uint16)(cnt >> 1));
+			n = cnt & ~1;
+			buf += n;
+			up += n;
+			cnt -= n;
+		}
+		if(cnt != 0){
+			/* Odd trailing byte is the high byte of a word */
+			sum += (uint16)*up << 8;
+			*buf++ = *up;
+			odd = 1;
+		}
+	}
+	return (uint16)(~eac(sum) & 0xffff);
+}
@@ -28,12 +28,48 @@ struct route R_default = {		/* Default route entry */
 	RIP_INFINITY		/* Init metric to infinity */
 };
 
-static struct rt_cache Rt_cache[HASHMOD];
+/* Route cache, RTCWAYS-way set associative. The entries in each set are
+ * kept in most-recently-used order, so the last one is the LRU victim.
+ * Entries are only valid for the generation of the routing table they
+ * were made in; any table change just bumps Rtgen.
+ */
+struct rt_cache Rt_cache[RTCSETS][RTCWAYS];
+int32 Rtgen = 1;	/* Routing table generation, never 0 */
 int32 Rtlookups;
 int32 Rtchits;
+int32 Rtcstale;		/* Misses on entries from an old generation */
+int32 Rtcevicts[RTCSETS];	/* Valid entries evicted from each set */
+
+/* Longest-prefix-match index over the Routes[][] hash chains. This is a
+ * path-compressed binary (Patricia) trie: each node holds a prefix and
+ * branches on the bit just past it, and nodes with only one child exist
+ * only where they carry a route. rt_lookup() walks at most one node per
+ * distinguishing bit instead of probing all 32 prefix lengths.
+ */
+struct rtnode {
+	int32 key;		/* Prefix, don't-care bits zero */
+	unsigned int bits;	/* Prefix length, 0-32 */
+	struct route *route;	/* Route for this prefix, NULL if glue node */
+	struct rtnode *child[2];	/* Indexed by bit following prefix */
+};
+static struct rtnode *Rtroot;
+int32 Rtnodes;		/* Nodes in trie */
+int32 Rtroutes;		/* Routes in trie (default route not included) */
+
+#define	RTMASK(bits)	((bits) == 0 ? 0L : ~0L << (32-(bits)))
+#define	RTBIT(key,n)	((int)((key) >> (31-(n))) & 1)
 
 static int q_pkt(struct iface *iface,int32 gateway,struct ip *ip,
 	struct mbuf **bpp,int ckgood);
+static uint16 link_hdrroom(struct iface *iface);
+static struct rtnode *rt_setnode(struct rtnode *np,int32 key,
+	unsigned int bits,struct route *rp);
+static void rt_trieadd(struct route *rp);
+static void rt_triedrop(int32 key,unsigned int bits);
+static int rt_chash(int32 target);
+static struct route *rt_find(int32 target);
+static struct route *rt_peek(int32 target);
+static void rr_store(struct ip *ip,int i,int32 addr);
 
 /* Initialize modulo lookup table used by hash_ip() in pcgen.asm */
 void
@@ -45,6 +81,30 @@ ipinit(void)
 		Hashtab[i] = i % HASHMOD;
 }
 
+/* Store an address in the route option starting at ip->options[i] and
+ * advance its pointer, updating the header checksum to match rather
+ * than having htonip() recompute it. The caller has checked there's room.
+ */
+static void
+rr_store(
+struct ip *ip,
+int i,
+int32 addr
+){
+	uint8 *opt;
+	uint8 new[4];
+	int pointer;
+
+	opt = &ip->options[i];
+	pointer = opt[2];
+	put32(new,addr);
+	ip->checksum = csum_adjbytes(ip->checksum,IPLEN+i+pointer,
+	 &opt[pointer],new,4);
+	memcpy(&opt[pointer],new,4);
+	new[0] = pointer + 4;
+	ip->checksum = csum_adjbytes(ip->checksum,IPLEN+i+2,&opt[2],new,1);
+	opt[2] = new[0];
+}
 /* Route an IP datagram. This is the "hopper" through which all IP datagrams,
  * coming or going, must pass.
  *
@@ -72,6 +132,7 @@ int rxbroadcast		/* True if packet had link broadcast address */
 	int i;
 	int ckgood = IP_CS_OLD; /* Has good checksum without modification */
 	int pointer;		/* Relative pointer index for sroute/rroute */
+	int32 nexthop;		/* Next hop from source route */
 
 	if(i_iface != NULL){
 		ipInReceives++;	/* Not locally generated */
@@ -173,10 +234,10 @@ int rxbroadcast		/* True if packet had link broadcast address */
 			 * put our address into the route field, and bump
 			 * the pointer. We've already ensured enough space.
 			 */
-			ip.dest = get32(&opt[pointer]);
-			put32(&opt[pointer],locaddr(ip.dest));
-			opt[2] += 4;
-			ckgood = IP_CS_NEW;
+			nexthop = get32(&opt[pointer]);
+			ip.checksum = csum_adjust32(ip.checksum,ip.dest,nexthop);
+			ip.dest = nexthop;
+			rr_store(&ip,i,locaddr(ip.dest));
 			break;
 		case IP_RROUTE:	/* Record route */
 			if(opt_len < 3){
@@ -210,9 +271,7 @@ int rxbroadcast		/* True if packet had link broadcast address */
 				/* Add our address to the route.
 				 * We've already ensured there's enough space.
 				 */
-				put32(&opt[pointer],locaddr(ip.dest));
-	 			opt[2] += 4;
-				ckgood = IP_CS_NEW;
+				rr_store(&ip,i,locaddr(ip.dest));
 			}
 			break;
 		}
@@ -240,10 +299,9 @@ no_opt:
 	if(i_iface != NULL)
 		ipForwDatagrams++;
 
-	/* Adjust the header checksum to allow for the modified TTL */		
-	ip.checksum += 0x100;
-	if((ip.checksum & 0xff00) == 0)
-		ip.checksum++;	/* end-around carry */
+	/* Adjust the header checksum to allow for the modified TTL */
+	ip.checksum = csum_adjust(ip.checksum,(ip.ttl << 8) | ip.protocol,
+	 ((ip.ttl-1) << 8) | ip.protocol);
 
 	/* Decrement TTL and discard if zero. We don't have to check
 	 * rxbroadcast here because it's already been checked
@@ -381,6 +439,10 @@ int ckgood
 	int i;
 
 	iface->ipsndcnt++;
+	/* Make room for the IP header, the queue header and the link
+	 * header all at once, so none of them need their own mbuf
+	 */
+	hdrroom(bpp,IPLEN + ip->optlen + link_hdrroom(iface));
 	htonip(ip,bpp,ckgood);
 
 	/* create priority field consisting of tos with 2 unused
@@ -474,6 +536,39 @@ uint8 tos
 	 */
 	return ip_send(Encap.addr,gateway,IP_PTCL,tos,0,bpp,0,0,0);
 }
+/* Space for the queue and link headers below a datagram on iface. if_tx()
+ * pulls the queue header off before the link header is pushed on, so the
+ * two share the same bytes
+ */
+static uint16
+link_hdrroom(
+struct iface *iface
+){
+	uint16 hdrlen;
+
+	hdrlen = iface->iftype != NULL ? iface->iftype->hdrlen : 0;
+	return max(hdrlen,sizeof(struct qhdr));
+}
+/* Return the space a transport protocol should leave at the front of a
+ * new datagram to 'target' for the IP, queue and link headers that will
+ * be added beneath it, so that pushdown() can put them there in place
+ */
+uint16
+ip_hdrroom(int32 target)
+{
+	struct route *rp;
+	uint16 room = IPLEN;
+
+	if((rp = rt_peek(target)) == NULL)
+		return room + sizeof(struct qhdr);
+	if(rp->iface == &Encap){
+		/* Another IP header, then whatever the gateway's route adds */
+		room += IPLEN;
+		if((rp = rt_peek(rp->gateway)) == NULL || rp->iface == &Encap)
+			return room + sizeof(struct qhdr);
+	}
+	return room + link_hdrroom(rp->iface);
+}
 /* Add an entry to the IP routing table. Returns 0 on success, -1 on failure */
 struct route *
 rt_add(
@@ -486,7 +581,6 @@ int32 ttl,		/* Lifetime of this route entry in sec */
 uint8 private		/* Inhibit advertising this entry ? */
 ){
 	struct route *rp,**hp;
-	int i;
 
 	if(iface == NULL)
 		return NULL;
@@ -506,8 +600,7 @@ uint8 private		/* Inhibit advertising this entry ? */
 	if(iface == &Encap && (gateway == 0 || ismyaddr(gateway)))
 		return NULL;
 
-	for(i=0;i<HASHMOD;i++)
-		Rt_cache[i].route = NULL;	/* Flush cache */
+	Rtgen++;	/* Invalidate cache */
 
 	/* Zero bits refers to the default route */
 	if(bits == 0){
@@ -520,6 +613,13 @@ uint8 private		/* Inhibit advertising this entry ? */
 		 * entry and put it in.
 		 */
 		rp = (struct route *)callocw(1,sizeof(struct route));
+		rp->uses = 0;
+		rp->target = target;
+		rp->bits = bits;
+		/* Index it first; rt_trieadd() may block for memory, and
+		 * the entry mustn't be found in the table until it's done
+		 */
+		rt_trieadd(rp);
 		/* Insert at head of table */
 		rp->prev = NULL;
 		hp = &Routes[bits-1][hash_ip(target)];
@@ -527,7 +627,6 @@ uint8 private		/* Inhibit advertising this entry ? */
 		if(rp->next != NULL)
 			rp->next->prev = rp;
 		*hp = rp;
-		rp->uses = 0;
 	}
 	rp->target = target;
 	rp->bits = bits;
@@ -538,6 +637,7 @@ uint8 private		/* Inhibit advertising this entry ? */
 	rp->timer.func = rt_timeout;  /* Set the timer field */
 	rp->timer.arg = (void *)rp;
 	set_timer(&rp->timer,ttl*1000L);
+	set_timer_slack(&rp->timer,1000L);
 	stop_timer(&rp->timer);
 	start_timer(&rp->timer); /* start the timer if appropriate */
 
@@ -553,10 +653,8 @@ int32 target,
 unsigned int bits
 ){
 	register struct route *rp;
-	int i;
 
-	for(i=0;i<HASHMOD;i++)
-		Rt_cache[i].route = NULL;	/* Flush the cache */
+	Rtgen++;	/* Invalidate the cache */
 
 	if(bits == 0){
 		/* Nail the default entry */
@@ -586,9 +684,115 @@ unsigned int bits
 	else
 		Routes[bits-1][hash_ip(target)] = rp->next;
 
+	rt_triedrop(target,bits);
 	free(rp);
 	return 0;
 }
+/* Fill in a node allocated ahead of time and count it in the trie */
+static struct rtnode *
+rt_setnode(
+struct rtnode *np,
+int32 key,
+unsigned int bits,
+struct route *rp
+){
+	np->key = key & RTMASK(bits);
+	np->bits = bits;
+	np->route = rp;
+	Rtnodes++;
+	return np;
+}
+/* Index a new route entry in the trie. The one or two nodes the insert
+ * may need are allocated before walking the trie, since callocw() can
+ * block and other processes may change the trie meanwhile; from the
+ * walk on, nothing blocks.
+ */
+static void
+rt_trieadd(
+struct route *rp
+){
+	struct rtnode **npp,*np,*new,*leaf,*glue;
+	unsigned int common,max;
+	int32 diff;
+
+	leaf = (struct rtnode *)callocw(1,sizeof(struct rtnode));
+	glue = (struct rtnode *)callocw(1,sizeof(struct rtnode));
+	for(npp = &Rtroot;(np = *npp) != NULL;npp = &np->child[RTBIT(rp->target,np->bits)]){
+		/* Count the leading bits this node has in common with the
+		 * new prefix, up to the shorter of the two
+		 */
+		max = min(np->bits,rp->bits);
+		diff = np->key ^ rp->target;
+		for(common = 0;common < max && RTBIT(diff,common) == 0;common++)
+			;
+		if(common < np->bits)
+			break;	/* Node isn't a prefix of the new one */
+		if(np->bits == rp->bits){
+			np->route = rp;	/* Glue node becomes a real one */
+			Rtroutes++;
+			free(leaf);
+			free(glue);
+			return;
+		}
+	}
+	Rtroutes++;
+	if(np == NULL){
+		*npp = rt_setnode(leaf,rp->target,rp->bits,rp);
+		free(glue);
+		return;
+	}
+	if(common == rp->bits){
+		/* New prefix is a prefix of this node; put it above */
+		new = rt_setnode(leaf,rp->target,rp->bits,rp);
+		new->child[RTBIT(np->key,common)] = np;
+		free(glue);
+	} else {
+		/* They diverge; join them under a glue node */
+		new = rt_setnode(glue,rp->target,common,NULL);
+		new->child[RTBIT(np->key,common)] = np;
+		new->child[RTBIT(rp->target,common)] =
+		 rt_setnode(leaf,rp->target,rp->bits,rp);
+	}
+	*npp = new;
+}
+/* Remove a route from the trie, freeing nodes no longer needed */
+static void
+rt_triedrop(
+int32 key,
+unsigned int bits
+){
+	struct rtnode **npp,**parpp,*np,*parent,*child;
+
+	parpp = NULL;
+	parent = NULL;
+	for(npp = &Rtroot;(np = *npp) != NULL;npp = &np->child[RTBIT(key,np->bits)]){
+		if(np->bits > bits || ((np->key ^ key) & RTMASK(np->bits)) != 0)
+			return;	/* Not in trie */
+		if(np->bits == bits)
+			break;
+		parpp = npp;
+		parent = np;
+	}
+	if(np == NULL || np->route == NULL)
+		return;
+	np->route = NULL;
+	Rtroutes--;
+	if(np->child[0] != NULL && np->child[1] != NULL)
+		return;		/* Still needed as a glue node */
+
+	/* Splice out this node */
+	child = np->child[0] != NULL ? np->child[0] : np->child[1];
+	*npp = child;
+	free(np);
+	Rtnodes--;
+
+	/* If that left a glue node with only one child, splice it out too */
+	if(child == NULL && parent != NULL && parent->route == NULL){
+		*parpp = parent->child[0] != NULL ? parent->child[0] : parent->child[1];
+		free(parent);
+		Rtnodes--;
+	}
+}
 #ifdef	notdef
 
 /* Compute hash function on IP address */
@@ -686,41 +890,106 @@ rt_lookup(target)
 int32 target;
 {
 	register struct route *rp;
-	int bits;
-	int32 tsave;
-	int32 mask;
-	struct rt_cache *rcp;
+	int n,set,victim;
+	struct rt_cache *rcp,hit;
 
 	Rtlookups++;
 	/* Examine cache first */
-	rcp = &Rt_cache[hash_ip(target)];
-	if(target == rcp->target && (rp = rcp->route) != NULL){
-		Rtchits++;
-		return rp;
-	}
-	tsave = target;
-
-	mask = ~0;	/* All ones */
-	for(bits = 31;bits >= 0; bits--){
-		target &= mask;
-		for(rp = Routes[bits][hash_ip(target)];rp != NULL;rp = rp->next){
-			if(rp->target != target
-			 || (rp->iface == &Encap && rp->gateway == tsave))
-				continue;
-			/* Stash in cache and return */
-			rcp->target = tsave;
-			rcp->route = rp;
-			return rp;
+	set = rt_chash(target);
+	victim = RTCWAYS-1;
+	for(n=0;n<RTCWAYS;n++){
+		rcp = &Rt_cache[set][n];
+		if(rcp->target != target || rcp->route == NULL)
+			continue;
+		if(rcp->gen != Rtgen){
+			Rtcstale++;
+			victim = n;	/* Reuse its slot */
+			break;
 		}
-		mask <<= 1;
+		/* Move to the front of the set */
+		Rtchits++;
+		hit = *rcp;
+		for(;n > 0;n--)
+			Rt_cache[set][n] = Rt_cache[set][n-1];
+		Rt_cache[set][0] = hit;
+		return hit.route;
+	}
+	/* Miss; make room at the front of the set for the new entry */
+	rcp = &Rt_cache[set][victim];
+	if(rcp->route != NULL && rcp->gen == Rtgen)
+		Rtcevicts[set]++;
+	for(n=victim;n > 0;n--)
+		Rt_cache[set][n] = Rt_cache[set][n-1];
+	rcp = &Rt_cache[set][0];
+	rcp->route = NULL;
+	rcp->gen = Rtgen;
+	if((rp = rt_find(target)) != NULL){
+		/* Stash in cache */
+		rcp->target = target;
+		rcp->route = rp;
+	}
+	return rp;
+}
+/* Look up target in the route cache without disturbing it or the
+ * statistics, falling back to the trie on a miss. For callers that only
+ * want a hint about the route a datagram is about to take.
+ */
+static struct route *
+rt_peek(
+int32 target
+){
+	struct rt_cache *rcp;
+	int n;
+
+	rcp = Rt_cache[rt_chash(target)];
+	for(n=0;n<RTCWAYS;n++,rcp++){
+		if(rcp->target == target && rcp->route != NULL
+		 && rcp->gen == Rtgen)
+			return rcp->route;
 	}
-	if(R_default.iface != NULL){
-		rcp->target = tsave;
-		rcp->route = &R_default;
+	return rt_find(target);
+}
+/* Longest prefix match for target in the trie, or the default route */
+static struct route *
+rt_find(
+int32 target
+){
+	register struct route *rp;
+	struct rtnode *np;
+	struct route *best;
+
+	/* Prefixes get longer on the way down the trie, so the last matching
+	 * route seen is the longest. Don't route an encapsulated packet back
+	 * through the tunnel to its own gateway
+	 */
+	best = NULL;
+	for(np = Rtroot;np != NULL;np = np->child[RTBIT(target,np->bits)]){
+		if(((np->key ^ target) & RTMASK(np->bits)) != 0)
+			break;
+		rp = np->route;
+		if(rp != NULL && (rp->iface != &Encap || rp->gateway != target))
+			best = rp;
+		if(np->bits == 32)
+			break;
+	}
+	if(best != NULL)
+		return best;
+	if(R_default.iface != NULL)
 		return &R_default;
-	} else
+	else
 		return NULL;
 }
+/* Pick the route cache set for a target address */
+static int
+rt_chash(
+int32 target
+){
+	register uint16 x;
+
+	x = hiword(target) ^ loword(target);
+	x ^= x >> 8;
+	return x & (RTCSETS-1);
+}
 /* Search routing table for entry with specific width */
 struct route *
 rt_blookup(target,bits)
@@ -21,15 +21,40 @@ FILE *proctrace;
 #endif
 int Stkchk = 0;
 struct proc *Curproc;		/* Currently running process */
-struct proc *Rdytab;		/* Processes ready to run (not including curproc) */
-struct proc *Waittab[PHASH];	/* Waiting process list */
-struct proc *Susptab;		/* Suspended processes */
+/* Processes ready to run (not including curproc), one list per priority.
+ * The highest priority list is served first, but a process that has been
+ * passed over PRIAGE times in favor of higher priority ones runs next.
+ */
+struct proc *Rdytab[NPRI];
+static struct proc *Rdytail[NPRI];	/* Last entries on same */
+static unsigned Nready;		/* Processes on the ready lists */
+static int Rdyskip[NPRI];	/* Dispatches since each list was last served */
+struct proc *Susptab;		/* Suspended processes not waiting on events */
+static struct proc *Susptail;
+
+/* Waiting processes, including suspended ones, are hashed on their events.
+ * The table starts with PHASH chains and is grown by a factor of four
+ * each time the number of waiting processes exceeds twice the number
+ * of chains, so the chain that ksig() has to search stays short.
+ */
+static struct proc *Waitinit[PHASH];
+static struct proc *Waitinittail[PHASH];
+struct proc **Waittab = Waitinit;	/* Heads of wait hash chains */
+static struct proc **Waittail = Waitinittail;	/* Tails of same */
+unsigned Nwaithash = PHASH;	/* Number of chains, always a power of two */
+unsigned Nwaiting;		/* Processes on the wait chains */
+#define	MAXWHASH	1024	/* Largest wait hash table */
+#define	WHASH(event)	(phash(event) & (Nwaithash-1))
 static struct mbuf *Killq;
 struct ksig Ksig;
 int Kdebug;		/* Control display of current task on screen */
 
 static void addproc(struct proc *entry);
 static void delproc(struct proc *entry);
+static void proclist(struct proc *entry,struct proc ***headp,
+	struct proc ***tailp);
+static void rehash(unsigned size);
+static struct proc *nextproc(void);
 
 static void ksig(void *event,int n);
 static int procsigs(void);
@@ -50,6 +75,8 @@ mainproc(char *name)
 
 	/* Create name */
 	pp->name = strdup(name);
+	pp->pri = PRI_NORM;
+	pp->runstart = msclock();
 #ifndef	AMIGA
 	pp->stksize = 0;
 #else
@@ -90,6 +117,7 @@ int freeargs		/* If set, free arg list on parg1 at termination */
 
 	/* Create name */
 	pp->name = strdup(name);
+	pp->pri = PRI_NORM;
 
 	/* Allocate stack */
 #ifdef	AMIGA
@@ -227,6 +255,19 @@ resume(struct proc *pp)
 	addproc(pp);
 }
 
+/* Change the scheduling priority of a process */
+void
+setpri(struct proc *pp,int pri)
+{
+	if(pp == NULL || pri < 0 || pri >= NPRI)
+		return;
+	if(pp != Curproc)
+		delproc(pp);	/* Might be on a ready list */
+	pp->pri = pri;
+	if(pp != Curproc)
+		addproc(pp);
+}
+
 /* Wakeup waiting process, regardless of event it's waiting for. The process
  * will see a return value of "val" from its kwait() call. Must not be
  * called from an interrupt handler.
@@ -245,6 +286,8 @@ alert(struct proc *pp,int val)
 #endif
 	if(pp != Curproc)
 		delproc(pp);
+	if(pp->flags.waiting)
+		pp->lastwait = msclock() - pp->waitstart;
 	pp->flags.waiting = 0;
 	pp->retval = val;
 	pp->event = NULL;
@@ -272,6 +315,7 @@ kwait(void *event)
 	register struct proc *oldproc;
 	int tmp;
 	int i_state;
+	int32 slice;
 
 	if(!istate()){
 		stktrace();
@@ -298,6 +342,7 @@ kwait(void *event)
 		/* Post a wait for the specified event */
 		Curproc->event = event;
 		Curproc->flags.waiting = 1;
+		Curproc->waitstart = msclock();
 		addproc(Curproc);	/* Put us on the wait list */
 	}
 	/* If the signal queue contains a signal for the event that we're
@@ -306,7 +351,7 @@ kwait(void *event)
 	procsigs();
 	if(event == NULL){
 		/* We remain runnable */
-		if(Rdytab == NULL){
+		if(Nready == 0){
 			/* Nothing else is ready, so just return */
 			Ksig.kwaitnops++;
 			restore(i_state);
@@ -314,10 +359,18 @@ kwait(void *event)
 		}
 		addproc(Curproc); /* Put us on the end of the ready list */
 	}
+	/* Charge the current process for the time since it was dispatched.
+	 * Any idle time below isn't charged to anyone.
+	 */
+	slice = msclock() - Curproc->runstart;
+	Curproc->cputime += slice;
+	if(slice > Curproc->maxslice)
+		Curproc->maxslice = slice;
+
 	/* Look for a ready process and run it. If there are none,
 	 * loop or halt until an interrupt makes something ready.
 	 */
-	while(Rdytab == NULL){
+	while(Nready == 0){
 		/* Give system back to upper-level multitasker, if any.
 		 * Note that this function enables interrupts internally
 		 * to prevent deadlock, but it restores our state
@@ -330,10 +383,12 @@ kwait(void *event)
 		/* Process signals that occurred during the giveup() */
 		procsigs();
 	}
-	/* Remove first entry from ready list */
+	/* Remove next entry from ready lists */
 	oldproc = Curproc;
-	Curproc = Rdytab;
+	Curproc = nextproc();
 	delproc(Curproc);
+	Curproc->switches++;
+	Curproc->runstart = msclock();
 
 	if(Kdebug)
 		debug(Curproc->name);
@@ -470,9 +525,13 @@ int n		/* Max number of processes to wake up */
 	if(n == 0)
 		n = 65535;
 
-	hashval = phash(event);
+	/* Suspended processes waiting on the event are on the same chain;
+	 * signaling them just moves them to the suspended list
+	 */
+	hashval = WHASH(event);
 	for(pp = Waittab[hashval];n != 0 && pp != NULL;pp = pnext){
 		pnext = pp->next;
+		Ksig.ksigscans++;
 		if(pp->event == event){
 #ifdef	PROCTRACE
 				logmsg(-1,"ksignal(%p,%u) wake %p [%s]",event,n,
@@ -480,6 +539,7 @@ int n		/* Max number of processes to wake up */
 #endif
 			delproc(pp);
 			pp->flags.waiting = 0;
+			pp->lastwait = msclock() - pp->waitstart;
 			pp->retval = 0;
 			pp->event = NULL;
 			addproc(pp);
@@ -487,22 +547,6 @@ int n		/* Max number of processes to wake up */
 			cnt++;
 		}
 	}
-	for(pp = Susptab;n != 0 && pp != NULL;pp = pnext){
-		pnext = pp->next;
-		if(pp->event == event){
-#ifdef	PROCTRACE
-				logmsg(-1,"ksignal(%p,%u) wake %p [%s]",event,n,
-				 pp,pp->name);
-#endif /* PROCTRACE */
-			delproc(pp);
-			pp->flags.waiting = 0;
-			pp->event = 0;
-			pp->retval = 0;
-			addproc(pp);
-			n--;
-			cnt++;
-		}
-	}
 	if(cnt == 0)
 		Ksig.ksignops++;
 	else
@@ -516,54 +560,146 @@ chname(struct proc *pp,char *newname)
 	free(pp->name);
 	pp->name = strdup(newname);
 }
+/* Find the list a process entry belongs on, according to its flags.
+ * A waiting process goes on its event's hash chain even if it is
+ * also suspended.
+ */
+static void
+proclist(
+struct proc *entry,
+struct proc ***headp,
+struct proc ***tailp
+){
+	unsigned hashval;
+
+	if(entry->flags.waiting){
+		hashval = WHASH(entry->event);
+		*headp = &Waittab[hashval];
+		*tailp = &Waittail[hashval];
+	} else if(entry->flags.suspend){
+		*headp = &Susptab;
+		*tailp = &Susptail;
+	} else {	/* Ready */
+		*headp = &Rdytab[entry->pri];
+		*tailp = &Rdytail[entry->pri];
+	}
+}
+/* Pick the next process to run: the head of the highest priority ready
+ * list, unless a lower priority list has been passed over PRIAGE times.
+ * Must only be called when Nready != 0.
+ */
+static struct proc *
+nextproc(void)
+{
+	struct proc *pp;
+	int i,pri;
+
+	pri = -1;
+	for(i=NPRI-1;i>0;i--){
+		if(Rdytab[i] != NULL && Rdyskip[i] >= PRIAGE){
+			pri = i;
+			Ksig.praged++;
+			break;
+		}
+	}
+	if(pri == -1){
+		for(pri=0;Rdytab[pri] == NULL;pri++)
+			;
+	}
+	/* Every other waiting list has been passed over once more */
+	for(i=0;i<NPRI;i++){
+		if(i == pri || Rdytab[i] == NULL)
+			Rdyskip[i] = 0;
+		else
+			Rdyskip[i]++;
+	}
+	pp = Rdytab[pri];
+	Ksig.pruns[pri]++;
+	Ksig.prwait[pri] += msclock() - pp->rdytime;
+	return pp;
+}
 /* Remove a process entry from the appropriate table */
 static void
 delproc(struct proc *entry)	/* Pointer to entry */
 {
+	struct proc **head,**tail;
+
 	if(entry == NULL)
 		return;
 
+	proclist(entry,&head,&tail);
 	if(entry->next != NULL)
 		entry->next->prev = entry->prev;
-	if(entry->prev != NULL){
+	else
+		*tail = entry->prev;
+	if(entry->prev != NULL)
 		entry->prev->next = entry->next;
-	} else {
-		if(entry->flags.suspend){
-			Susptab = entry->next;
-		} else if(entry->flags.waiting){
-			Waittab[phash(entry->event)] = entry->next;
-		} else {	/* Ready */
-			Rdytab = entry->next;
-		}
-	}
+	else
+		*head = entry->next;
+	if(entry->flags.waiting)
+		Nwaiting--;
+	else if(!entry->flags.suspend)
+		Nready--;
 }
 /* Append proc entry to end of appropriate list */
 static void
 addproc(struct proc *entry)	/* Pointer to entry */
 {
-	register struct proc *pp;
-	struct proc **head;
+	struct proc **head,**tail;
 
 	if(entry == NULL)
 		return;
 
-	if(entry->flags.suspend){
-		head = &Susptab;
-	} else if(entry->flags.waiting){
-		head = &Waittab[phash(entry->event)];
-	} else {	/* Ready */
-		head = &Rdytab;
+	if(entry->flags.waiting && ++Nwaiting > 2*Nwaithash
+	 && Nwaithash < MAXWHASH)
+		rehash(4*Nwaithash);
+
+	if(!entry->flags.waiting && !entry->flags.suspend){
+		Nready++;
+		entry->rdytime = msclock();
 	}
+	proclist(entry,&head,&tail);
 	entry->next = NULL;
-	if(*head == NULL){
-		/* Empty list, stick at beginning */
-		entry->prev = NULL;
-		*head = entry;
-	} else {
-		/* Find last entry on list */
-		for(pp = *head;pp->next != NULL;pp = pp->next)
-			;
-		pp->next = entry;
-		entry->prev = pp;
+	if((entry->prev = *tail) == NULL)
+		*head = entry;	/* Empty list, stick at beginning */
+	else
+		entry->prev->next = entry;
+	*tail = entry;
+}
+/* Move the wait chains into a bigger hash table. The order of the
+ * processes waiting on any one event is preserved. If there isn't
+ * memory for the new table, just keep using the old one.
+ */
+static void
+rehash(unsigned size)
+{
+	struct proc **oldtab,**newtab,**newtail;
+	struct proc *pp,*pnext;
+	unsigned i,oldsize,hashval;
+
+	/* Can't use mallocw() here; we're in the middle of the scheduler */
+	if((newtab = (struct proc **)malloc(2*size*sizeof(struct proc *))) == NULL)
+		return;
+	memset(newtab,0,2*size*sizeof(struct proc *));
+	newtail = newtab + size;
+
+	oldtab = Waittab;
+	oldsize = Nwaithash;
+	Waittab = newtab;
+	Waittail = newtail;
+	Nwaithash = size;
+	for(i=0;i<oldsize;i++){
+		for(pp = oldtab[i];pp != NULL;pp = pnext){
+			pnext = pp->next;
+			hashval = WHASH(pp->event);
+			pp->next = NULL;
+			if((pp->prev = newtail[hashval]) == NULL)
+				newtab[hashval] = pp;
+			else
+				pp->prev->next = pp;
+			newtail[hashval] = pp;
+		}
 	}
+	if(oldtab != Waitinit)
+		free(oldtab);	/* Tails were allocated with it */
 }
@@ -35,9 +35,25 @@ struct env {
 	unsigned	ds;
 };
 
+/* Snapshot of a process's accounting for "ps -v", taken all at once since
+ * processes can come and go while the listing is being printed
+ */
+struct psv {
+	struct proc *pp;
+	char name[16];
+	int pri;
+	int32 switches;
+	int32 cputime;
+	int32 maxslice;
+	int32 lastwait;
+};
+
 static int chkintstk(void);
 static int stkutil(struct proc *pp);
 static void pproc(struct proc *pp);
+static int psverbose(void);
+static int psvsnap(struct psv *tab,int max,struct proc *pp,int n);
+static int psvcomp(const void *a,const void *b);
 
 void
 kinit()
@@ -70,6 +86,9 @@ void *p;
 	register struct proc *pp;
 	int i;
 
+	if(argc > 1 && strcmp(argv[1],"-v") == 0)
+		return psverbose();
+
 	printf("Uptime %s Stack %x max intstk %u psp %x",tformat(secclock()),
 	 getss(),chkintstk(),_psp);
 	if(Mtasker != 0){
@@ -82,23 +101,114 @@ void *p;
 	Ksig.maxentries = 0;
 	printf("kwaits %lu nops %lu from int %lu\n",
 	 Ksig.kwaits,Ksig.kwaitnops,Ksig.kwaitints);
-	printf("PID       SP        stksize   maxstk    event     fl  in  out  name\n");
+	printf("wait hash chains %u waiting %u ksig scans %lu (%lu/ksig)\n",
+	 Nwaithash,Nwaiting,Ksig.ksigscans,
+	 Ksig.ksigs != 0 ? Ksig.ksigscans/Ksig.ksigs : 0L);
+	for(i=0;i<NPRI;i++){
+		printf("pri %d runs %lu avg ready wait %lu ms\n",i,Ksig.pruns[i],
+		 Ksig.pruns[i] != 0 ? Ksig.prwait[i]/Ksig.pruns[i] : 0L);
+	}
+	printf("aged dispatches %lu\n",Ksig.praged);
+	timerstat();
+	printf("PID       SP        stksize   maxstk    event     fl  pr in  out  name\n");
 
 	for(pp = Susptab;pp != NULL;pp = pp->next)
 		pproc(pp);
 
-	for(i=0;i<PHASH;i++)
+	for(i=0;i<Nwaithash;i++)
 		for(pp = Waittab[i];pp != NULL;pp = pp->next)
 			pproc(pp);
 
-	for(pp = Rdytab;pp != NULL;pp = pp->next)
-		pproc(pp);
+	for(i=0;i<NPRI;i++)
+		for(pp = Rdytab[i];pp != NULL;pp = pp->next)
+			pproc(pp);
 
 	if(Curproc != NULL)
 		pproc(Curproc);
 
 	return 0;
 }
+/* List processes by decreasing CPU time, with their longest run slices.
+ * A process with a long maximum slice holds up everything else.
+ */
+static int
+psverbose()
+{
+	struct psv *tab;
+	struct proc *pp;
+	int i,n,max;
+
+	/* Size the table, leaving some slack for processes created while
+	 * we wait for memory
+	 */
+	max = 8 + (Curproc != NULL);
+	for(pp = Susptab;pp != NULL;pp = pp->next)
+		max++;
+	for(i=0;i<Nwaithash;i++)
+		for(pp = Waittab[i];pp != NULL;pp = pp->next)
+			max++;
+	for(i=0;i<NPRI;i++)
+		for(pp = Rdytab[i];pp != NULL;pp = pp->next)
+			max++;
+	tab = (struct psv *)mallocw(max * sizeof(struct psv));
+
+	/* Nothing below can block until the table is filled */
+	n = psvsnap(tab,max,Curproc,0);
+	for(pp = Susptab;pp != NULL;pp = pp->next)
+		n = psvsnap(tab,max,pp,n);
+	for(i=0;i<Nwaithash;i++)
+		for(pp = Waittab[i];pp != NULL;pp = pp->next)
+			n = psvsnap(tab,max,pp,n);
+	for(i=0;i<NPRI;i++)
+		for(pp = Rdytab[i];pp != NULL;pp = pp->next)
+			n = psvsnap(tab,max,pp,n);
+
+	qsort(tab,n,sizeof(struct psv),psvcomp);
+	printf("PID       pr switches  cpu ms     maxslice  lastwait  name\n");
+	for(i=0;i<n;i++){
+		printf("%-10p%-3d%-10lu%-10lu%-10lu%-10lu%s\n",tab[i].pp,
+		 tab[i].pri,tab[i].switches,tab[i].cputime,tab[i].maxslice,
+		 tab[i].lastwait,tab[i].name);
+	}
+	free(tab);
+	return 0;
+}
+static int
+psvsnap(tab,max,pp,n)
+struct psv *tab;
+int max;
+struct proc *pp;
+int n;
+{
+	if(pp == NULL || n >= max)
+		return n;
+	tab += n;
+	tab->pp = pp;
+	strncpy(tab->name,pp->name,sizeof(tab->name));
+	tab->name[sizeof(tab->name)-1] = '\0';
+	tab->pri = pp->pri;
+	tab->switches = pp->switches;
+	tab->cputime = pp->cputime;
+	tab->maxslice = pp->maxslice;
+	tab->lastwait = pp->lastwait;
+	return n+1;
+}
+/* Sort by decreasing CPU time */
+static int
+psvcomp(a,b)
+const void *a;
+const void *b;
+{
+	int32 ca,cb;
+
+	ca = ((struct psv *)a)->cputime;
+	cb = ((struct psv *)b)->cputime;
+	if(ca > cb)
+		return -1;
+	if(ca < cb)
+		return 1;
+	return 0;
+}
 static void
 pproc(pp)
 struct proc *pp;
@@ -115,13 +225,13 @@ struct proc *pp;
 		sprintf(outsock,"%3d",fileno(pp->output));
 	else
 		sprintf(outsock,"   ");
-	printf("%-10p%-10p%-10u%-10u%-10p%c%c%c %s %s  %s\n",
+	printf("%-10p%-10p%-10u%-10u%-10p%c%c%c %d %s %s  %s\n",
 	 pp,MK_FP(ep->ss,ep->sp),pp->stksize,stkutil(pp),
 	 pp->event,
 	 pp->flags.istate ? 'I' : ' ',
 	 pp->flags.waiting ? 'W' : ' ',
 	 pp->flags.suspend ? 'S' : ' ',
-	 insock,outsock,pp->name);
+	 pp->pri,insock,outsock,pp->name);
 }
 static int
 stkutil(pp)
@@ -244,8 +354,8 @@ void *event;
 	/* Fold the two halves of the pointer */
 	x = FP_SEG(event) ^ FP_OFF(event);
 
-	/* If PHASH is a power of two, this will simply mask off the
-	 * higher order bits
+	/* Mix the high order bits down too, since the caller masks
+	 * off as many low order bits as the wait table size needs
 	 */
-	return x % PHASH;
+	return x ^ (x >> 4) ^ (x >> 9);
 }
@@ -0,0 +1,78 @@
+/* Portable versions of the 1's complement checksum primitives for
+ * systems without the assembler versions in pcgen.s. Words are summed
+ * in machine order into a 32-bit accumulator, eight at a time, and the
+ * result is byte swapped at the end if necessary; the 1's complement
+ * sum is independent of byte order apart from that final swap.
+ *
+ * Copyright 1991 Phil Karn, KA9Q
+ */
+#include "global.h"
+#include "ip.h"
+
+static uint16 lcfold(int32 sum);
+
+uint16
+lcsum(
+register uint16 *wp,
+register uint16 len	/* Count of 16-bit words */
+){
+	register int32 sum = 0;
+
+	while(len >= 8){
+		sum += wp[0]; sum += wp[1]; sum += wp[2]; sum += wp[3];
+		sum += wp[4]; sum += wp[5]; sum += wp[6]; sum += wp[7];
+		wp += 8;
+		len -= 8;
+		/* Fold before the high half can overflow */
+		if(sum > 0x7ff00000L)
+			sum = (sum & 0xffffL) + ((sum >> 16) & 0xffffL);
+	}
+	while(len-- != 0)
+		sum += *wp++;
+	return lcfold(sum);
+}
+/* Copy len words from src to dst, returning their 1's complement sum */
+uint16
+lcsumcpy(
+register uint16 *dst,
+register uint16 *src,
+register uint16 len
+){
+	register int32 sum = 0;
+	register uint16 w;
+
+	while(len >= 8){
+		w = src[0]; dst[0] = w; sum += w;
+		w = src[1]; dst[1] = w; sum += w;
+		w = src[2]; dst[2] = w; sum += w;
+		w = src[3]; dst[3] = w; sum += w;
+		w = src[4]; dst[4] = w; sum += w;
+		w = src[5]; dst[5] = w; sum += w;
+		w = src[6]; dst[6] = w; sum += w;
+		w = src[7]; dst[7] = w; sum += w;
+		src += 8;
+		dst += 8;
+		len -= 8;
+		if(sum > 0x7ff00000L)
+			sum = (sum & 0xffffL) + ((sum >> 16) & 0xffffL);
+	}
+	while(len-- != 0){
+		w = *src++;
+		*dst++ = w;
+		sum += w;
+	}
+	return lcfold(sum);
+}
+/* Fold a machine-order sum to 16 bits and put it in network order */
+static uint16
+lcfold(
+int32 sum
+){
+	static uint16 one = 1;
+	uint16 csum;
+
+	csum = eac(sum);
+	if(*(uint8 *)&one == 1)
+		csum = (csum << 8) | (csum >> 8);	/* Little-endian */
+	return csum;
+}
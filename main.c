@@ -136,7 +136,8 @@ char *argv[];
 	for(tp=Daemons;;tp++){
 		if(tp->name == NULL)
 			break;
-		newproc(tp->name,tp->stksize,tp->fp,0,NULL,NULL,0);
+		setpri(newproc(tp->name,tp->stksize,tp->fp,0,NULL,NULL,0),
+		 tp->pri);
 	}
 	Encap.txproc = newproc("encap tx",512,if_tx,0,&Encap,NULL,0);
 	if(optind < argc){
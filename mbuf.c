@@ -13,49 +13,142 @@ static int32 Allocmbufs;	/* Calls to alloc_mbuf() */
 static int32 Freembufs;		/* Calls to free_mbuf() that actually free */
 static int32 Cachehits;		/* Hits on free mbuf cache */
 static unsigned long Msizes[16];
+static int32 Hdrrooms;		/* Calls to hdrroom() that had to allocate */
+static int32 Linearizes;	/* Calls to linearize() that copied */
+static int32 Lincopied;		/* Bytes copied by linearize() */
+
+/* Mbuf size classes. Each request is rounded up to the smallest class
+ * that will hold it, and freed mbufs go back on their class's free list
+ * instead of to the heap. Requests larger than the biggest class go
+ * straight to malloc(). The smallest class also holds the data-less
+ * headers made by dup_p().
+ */
+#define	MBBATCH		4	/* Mbufs fetched per free list refill */
+
+static struct mbclass {
+	uint16 size;		/* Data area size for this class */
+	struct mbuf *free;	/* Free list */
+	unsigned nfree;		/* Number on free list */
+	unsigned inuse;		/* Number currently allocated */
+	unsigned hiwat;		/* Most ever allocated at once */
+	int32 allocs;		/* Allocations from this class */
+	int32 hits;		/* Allocations satisfied from a free list */
+	int32 refills;		/* Batch refills from the heap */
+} Mbclass[NMBCLASS] = {
+	{ 32 },
+	{ 64 },
+	{ 256 },
+	{ 576 },
+	{ 1600 },
+	{ 4096 },
+};
+
+static struct mbuf *mbget(uint16 size,struct mbcache *cp,int wait);
+static int mbclassof(uint16 size);
+static struct mbuf *mbrefill(struct mbclass *mcp,int wait);
+
+/* Return the index of the smallest class that will hold 'size' bytes,
+ * or -1 if it's too big for any of them
+ */
+static int
+mbclassof(uint16 size)
+{
+	int i;
 
-#define	SMALL_MBUF	32
-#define	MED_MBUF	128
-#define	LARGE_MBUF	2048
-
-static struct mbuf *Mbufcache[3];
+	for(i=0;i<NMBCLASS;i++){
+		if(size <= Mbclass[i].size)
+			return i;
+	}
+	return -1;
+}
+/* Get a batch of new mbufs for an empty class free list from the heap.
+ * One is returned to the caller, the rest go on the free list.
+ */
+static struct mbuf *
+mbrefill(struct mbclass *mcp,int wait)
+{
+	struct mbuf *bp,*first;
+	int i,i_state;
 
-/* Allocate mbuf with associated buffer of 'size' bytes */
-struct mbuf *
-alloc_mbuf(uint16 size)
+	mcp->refills++;
+	if(wait)
+		first = (struct mbuf *)mallocw(mcp->size + sizeof(struct mbuf));
+	else
+		first = (struct mbuf *)malloc(mcp->size + sizeof(struct mbuf));
+	if(first == NULL)
+		return NULL;
+	for(i=1;i<MBBATCH;i++){
+		if((bp = (struct mbuf *)malloc(mcp->size + sizeof(struct mbuf))) == NULL)
+			break;
+		i_state = dirps();
+		bp->anext = mcp->free;
+		mcp->free = bp;
+		mcp->nfree++;
+		restore(i_state);
+	}
+	return first;
+}
+/* Common code for alloc_mbuf(), ambufw() and alloc_mbuf_c() */
+static struct mbuf *
+mbget(uint16 size,struct mbcache *cp,int wait)
 {
 	struct mbuf *bp = NULL;
-	int i;
-	int i_state;
+	struct mbclass *mcp;
+	int i,i_state;
 
 	Allocmbufs++;
 	/* Record the size of this request */
 	if((i = ilog2(size)) >= 0)
 		Msizes[i]++;
 
-	if(size <= SMALL_MBUF){
-		i = 0;
-		size = SMALL_MBUF;
-	} else if(size <= MED_MBUF){
-		i = 1;
-		size = MED_MBUF;
-	} else if(size <= LARGE_MBUF){
-		i = 2;
-		size = LARGE_MBUF;
-	} else
-		i = 3;
-
-	if(i < 3){
+	if((i = mbclassof(size)) == -1){
+		/* Too big for the pools */
+		if(wait)
+			bp = (struct mbuf *)mallocw(size + sizeof(struct mbuf));
+		else
+			bp = (struct mbuf *)malloc(size + sizeof(struct mbuf));
+	} else {
+		mcp = &Mbclass[i];
+		size = mcp->size;
 		i_state = dirps();
-		if(Mbufcache[i] != NULL){
-			bp = Mbufcache[i];
-			Mbufcache[i] = bp->anext;
+		mcp->allocs++;
+		if(cp != NULL && cp->free[i] == NULL){
+			/* Private cache is empty; move a batch over to it
+			 * from the global free list
+			 */
+			while(cp->nfree[i] < MBBATCH && mcp->free != NULL){
+				bp = mcp->free;
+				mcp->free = bp->anext;
+				mcp->nfree--;
+				bp->anext = cp->free[i];
+				cp->free[i] = bp;
+				cp->nfree[i]++;
+			}
+			cp->misses++;
+		} else if(cp != NULL)
+			cp->hits++;
+
+		if(cp != NULL && (bp = cp->free[i]) != NULL){
+			cp->free[i] = bp->anext;
+			cp->nfree[i]--;
+		} else if((bp = mcp->free) != NULL){
+			mcp->free = bp->anext;
+			mcp->nfree--;
+		}
+		if(bp != NULL){
+			mcp->hits++;
 			Cachehits++;
 		}
 		restore(i_state);
+		if(bp == NULL)
+			bp = mbrefill(mcp,wait);
+		if(bp != NULL){
+			i_state = dirps();
+			if(++mcp->inuse > mcp->hiwat)
+				mcp->hiwat = mcp->inuse;
+			restore(i_state);
+		}
 	}
-	if(bp == NULL)
-		bp = (struct mbuf *)malloc(size + sizeof(struct mbuf));
 	if(bp == NULL)
 		return NULL;
 	/* Clear just the header portion */
@@ -65,47 +158,49 @@ alloc_mbuf(uint16 size)
 	bp->refcnt++;
 	return bp;
 }
+/* Allocate mbuf with associated buffer of 'size' bytes */
+struct mbuf *
+alloc_mbuf(uint16 size)
+{
+	return mbget(size,NULL,0);
+}
 /* Allocate mbuf, waiting if memory is unavailable */
 struct mbuf *
 ambufw(uint16 size)
 {
-	struct mbuf *bp = NULL;
+	return mbget(size,NULL,1);
+}
+/* Allocate mbuf from a private cache, such as the one kept by each
+ * interface for its receiver. The cache is refilled in batches from
+ * the global free lists, so a busy receiver interrupt only rarely
+ * competes with other allocators for them. Like alloc_mbuf(), this
+ * may be called from interrupt level and doesn't wait.
+ */
+struct mbuf *
+alloc_mbuf_c(struct mbcache *cp,uint16 size)
+{
+	return mbget(size,cp,0);
+}
+/* Return all the mbufs in a private cache to the global free lists */
+void
+free_mbcache(struct mbcache *cp)
+{
+	struct mbuf *bp;
 	int i,i_state;
 
-	Allocmbufs++;
-	if((i = ilog2(size)) >= 0)
-		Msizes[i]++;
-
-	if(size <= SMALL_MBUF){
-		i = 0;
-		size = SMALL_MBUF;
-	} else if(size <= MED_MBUF){
-		i = 1;
-		size = MED_MBUF;
-	} else if(size <= LARGE_MBUF){
-		i = 2;
-		size = LARGE_MBUF;
-	} else
-		i = 3;
-
-	if(i < 3){
-		i_state = dirps();
-		if(Mbufcache[i] != NULL){
-			bp = Mbufcache[i];
-			Mbufcache[i] = bp->anext;
-			Cachehits++;
+	if(cp == NULL)
+		return;
+	i_state = dirps();
+	for(i=0;i<NMBCLASS;i++){
+		while((bp = cp->free[i]) != NULL){
+			cp->free[i] = bp->anext;
+			bp->anext = Mbclass[i].free;
+			Mbclass[i].free = bp;
+			Mbclass[i].nfree++;
 		}
-		restore(i_state);
+		cp->nfree[i] = 0;
 	}
-	if(bp == NULL)
-		bp = (struct mbuf *)mallocw(size + sizeof(struct mbuf));
-
-	/* Clear just the header portion */
-	memset(bp,0,sizeof(struct mbuf));
-	if((bp->size = size) != 0)
-		bp->data = (uint8 *)(bp + 1);
-	bp->refcnt++;
-	return bp;
+	restore(i_state);
 }
 
 /* Decrement the reference pointer in an mbuf. If it goes to zero,
@@ -118,6 +213,7 @@ free_mbuf(struct mbuf **bpp)
 	struct mbuf *bpnext;
 	struct mbuf *bptmp;
 	struct mbuf *bp;
+	struct mbclass *mcp;
 	int i_state;
 
 	if(bpp == NULL || (bp = *bpp) == NULL)
@@ -134,24 +230,19 @@ free_mbuf(struct mbuf **bpp)
 	if(--bp->refcnt <= 0){
 		Freembufs++;
 
+		/* Only mbufs from the pools have exactly a class size */
+		for(mcp = Mbclass;mcp < &Mbclass[NMBCLASS];mcp++){
+			if(bp->size == mcp->size)
+				break;
+		}
 		i_state = dirps();
-		switch(bp->size){
-		case SMALL_MBUF:
-			bp->anext = Mbufcache[0];
-			Mbufcache[0] = bp;
-			break;
-		case MED_MBUF:
-			bp->anext = Mbufcache[1];
-			Mbufcache[1] = bp;
-			break;
-		case LARGE_MBUF:
-			bp->anext = Mbufcache[2];
-			Mbufcache[2] = bp;
-			break;
-		default:
+		if(mcp != &Mbclass[NMBCLASS]){
+			bp->anext = mcp->free;
+			mcp->free = bp;
+			mcp->nfree++;
+			mcp->inuse--;
+		} else
 			free(bp);
-			break;
-		}
 		restore(i_state);
 	}
 	return bpnext;
@@ -453,6 +544,28 @@ pushdown(struct mbuf **bpp,void *buf,uint16 size)
 	if(buf != NULL)
 		memcpy(bp->data,buf,size);
 }
+/* Make sure there are at least 'size' bytes of free space at the front
+ * of a packet so that the protocol headers to be added by later calls to
+ * pushdown() can be put there in place. If there isn't enough, an empty
+ * mbuf with that much space at its end is put on the front of the chain,
+ * so at most one allocation is made no matter how many layers follow.
+ */
+void
+hdrroom(struct mbuf **bpp,uint16 size)
+{
+	struct mbuf *bp;
+
+	if(bpp == NULL)
+		return;
+	/* Same tests as in pushdown() */
+	if((bp = *bpp) != NULL && bp->refcnt == 1 && bp->dup == NULL
+	 && bp->data - (uint8 *)(bp+1) >= size)
+		return;
+	*bpp = ambufw(size);
+	(*bpp)->data += size;
+	(*bpp)->next = bp;
+	Hdrrooms++;
+}
 /* Append packet to end of packet queue */
 void
 enqueue(
@@ -586,19 +699,75 @@ mbuf_crunch(struct mbuf **bpp)
 	free_p(&bp);
 	*bpp = nbp;
 }
+/* Describe the segments of a packet in a vector for a scatter-gather
+ * driver, without copying anything. Empty mbufs are skipped. Return the
+ * number of segments used, or -1 if the packet has more than 'nvec'
+ * segments, in which case the driver should call linearize() instead.
+ */
+int
+mbuf_vec(struct mbuf *bp,struct mbvec *vec,int nvec)
+{
+	int n = 0;
+
+	for(;bp != NULL;bp = bp->next){
+		if(bp->cnt == 0)
+			continue;
+		if(n == nvec)
+			return -1;
+		vec[n].data = bp->data;
+		vec[n].cnt = bp->cnt;
+		n++;
+	}
+	return n;
+}
+/* Make a packet contiguous for a driver that can't handle mbuf chains.
+ * A packet that is already in a single mbuf is left alone; only chains
+ * are copied. Return -1 if the copy couldn't be made, in which case
+ * the packet is freed.
+ */
+int
+linearize(struct mbuf **bpp)
+{
+	struct mbuf *bp;
+	uint16 cnt;
+
+	if(bpp == NULL || *bpp == NULL)
+		return -1;
+	if((*bpp)->next == NULL)
+		return 0;	/* Already contiguous */
+	cnt = len_p(*bpp);
+	bp = copy_p(*bpp,cnt);
+	free_p(bpp);
+	if((*bpp = bp) == NULL)
+		return -1;
+	Linearizes++;
+	Lincopied += cnt;
+	return 0;
+}
 void
 mbufstat(void)
 {
+	struct mbclass *mcp;
+
 	printf("mbuf allocs %lu free cache hits %lu (%lu%%) mbuf frees %lu\n",
-	 Allocmbufs,Cachehits,100*Cachehits/Allocmbufs,Freembufs);
-	printf("pushdown calls %lu pushdown calls to alloc_mbuf %lu\n",
-	 Pushdowns,Pushalloc);
-	printf("Free cache: small %u medium %u large %u\n",
-	 len_q(Mbufcache[0]),len_q(Mbufcache[1]),len_q(Mbufcache[2]));
+	 Allocmbufs,Cachehits,Allocmbufs != 0 ? 100*Cachehits/Allocmbufs : 0L,
+	 Freembufs);
+	printf("pushdown calls %lu pushdown calls to alloc_mbuf %lu (%lu%%) hdrroom allocs %lu\n",
+	 Pushdowns,Pushalloc,Pushdowns != 0 ? 100*Pushalloc/Pushdowns : 0L,
+	 Hdrrooms);
+	printf("linearize copies %lu bytes copied %lu\n",Linearizes,Lincopied);
+	printf(" size   allocs     hits  hit%% refills inuse hiwat  free\n");
+	for(mcp = Mbclass;mcp < &Mbclass[NMBCLASS];mcp++){
+		printf("%5u %8lu %8lu %4lu%% %7lu %5u %5u %5u\n",
+		 mcp->size,mcp->allocs,mcp->hits,
+		 mcp->allocs != 0 ? 100*mcp->hits/mcp->allocs : 0L,
+		 mcp->refills,mcp->inuse,mcp->hiwat,mcp->nfree);
+	}
 }
 void
 mbufsizes(void)
 {
+	struct mbclass *mcp;
 	int i;
 
 	printf("Mbuf sizes:\n");
@@ -607,22 +776,29 @@ mbufsizes(void)
 		 1<<i,Msizes[i],2<<i,Msizes[i+1],
 		 4<<i,Msizes[i+2],8<<i,Msizes[i+3]);
 	}
+	printf("Mbuf classes (hit rate/high water):\n");
+	for(mcp = Mbclass;mcp < &Mbclass[NMBCLASS];mcp++){
+		printf("%5u: %3lu%%/%u%s",mcp->size,
+		 mcp->allocs != 0 ? 100*mcp->hits/mcp->allocs : 0L,
+		 mcp->hiwat,mcp == &Mbclass[NMBCLASS-1] ? "\n" : " | ");
+	}
 }
 /* Mbuf garbage collection - return all mbufs on free cache to heap */
 void
 mbuf_garbage(int red)
 {
 	int i_state;
-	int i;
+	struct mbclass *mcp;
 	struct mbuf *bp;
 
 	/* Blow entire cache */
-	for(i=0;i<3;i++){
+	for(mcp = Mbclass;mcp < &Mbclass[NMBCLASS];mcp++){
 		i_state = dirps();		
-		while((bp = Mbufcache[i]) != NULL){
-			Mbufcache[i] = bp->anext;
+		while((bp = mcp->free) != NULL){
+			mcp->free = bp->anext;
 			free(bp);
 		}
+		mcp->nfree = 0;
 		restore(i_state);
 	}
 }
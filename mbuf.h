@@ -23,6 +23,24 @@ struct mbuf {
 	uint16 cnt;
 };
 
+/* One segment of a packet, as handed to a scatter-gather driver */
+struct mbvec {
+	uint8 *data;
+	uint16 cnt;
+};
+
+#define	NMBCLASS	6	/* Number of mbuf size classes */
+
+/* Private cache of free mbufs, refilled in batches from the global
+ * size class free lists. Each interface keeps one for its receiver.
+ */
+struct mbcache {
+	struct mbuf *free[NMBCLASS];	/* Free lists, one per class */
+	uint16 nfree[NMBCLASS];		/* Lengths of same */
+	int32 hits;			/* Allocations found in the cache */
+	int32 misses;			/* Allocations that refilled it */
+};
+
 #define	PULLCHAR(bpp)\
  ((bpp) != NULL && (*bpp) != NULL && (*bpp)->cnt > 1 ? \
  ((*bpp)->cnt--,*(*bpp)->data++) : pullchar(bpp))
@@ -32,6 +50,8 @@ struct mbuf *alloc_mbuf(uint16 size);
 struct mbuf *free_mbuf(struct mbuf **bpp);
 
 struct mbuf *ambufw(uint16 size);
+struct mbuf *alloc_mbuf_c(struct mbcache *cp,uint16 size);
+void free_mbcache(struct mbcache *cp);
 struct mbuf *copy_p(struct mbuf *bp,uint16 cnt);
 uint16 dup_p(struct mbuf **hp,struct mbuf *bp,uint16 offset,uint16 cnt);
 uint16 extract(struct mbuf *bp,uint16 offset,void *buf,uint16 len);
@@ -50,6 +70,7 @@ uint16 dqdata(struct mbuf *bp,void *buf,unsigned cnt);
 
 void append(struct mbuf **bph,struct mbuf **bpp);
 void pushdown(struct mbuf **bpp,void *buf,uint16 size);
+void hdrroom(struct mbuf **bpp,uint16 size);
 uint16 pullup(struct mbuf **bph,void *buf,uint16 cnt);
 
 #define	pullchar(x) pull8(x)
@@ -65,6 +86,8 @@ uint8 *put32(uint8 *cp,int32 x);
 void iqstat(void);
 void refiq(void);
 void mbuf_crunch(struct mbuf **bpp);
+int mbuf_vec(struct mbuf *bp,struct mbvec *vec,int nvec);
+int linearize(struct mbuf **bpp);
 
 void mbufsizes(void);
 void mbufstat(void);
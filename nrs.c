@@ -226,6 +226,7 @@ void *v2;
 	struct nrs *np;
 
 	np = &Nrs[dev];
+	setpri(Curproc,PRI_NET);
 	/* Process any pending input */
 	while((c = np->get(np->iface->dev)) != EOF){
 		if((bp = nrs_decode(dev,c)) == NULL)
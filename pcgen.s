@@ -358,6 +358,47 @@ l0:	loop	deloop		; :-)
 	ret
 lcsum	endp
 
+; Copy data buffer and compute its 1's-complement sum in the same pass,
+; so the data only has to be fetched once
+;
+; Called from C as
+; unsigned short
+; lcsumcpy(dst,src,cnt)
+; unsigned short *dst;
+; unsigned short *src;
+; unsigned short cnt;
+	public	lcsumcpy
+lcsumcpy	proc
+	arg	dst:ptr,src:ptr,cnt:word
+
+	if	@Datasize NE 0
+		uses	ds,si,di
+		les	di,dst	; es:di = dst
+		lds	si,src	; ds:si = src
+	else
+		uses	si,di
+		mov	di,dst	; es:di = dst
+		mov	si,src	; ds:si = src
+		mov	ax,ds
+		mov	es,ax
+	endif
+
+	mov	cx,cnt		; cx = cnt
+	cld			; autoincrement si, di
+	mov	dx,0		; clear accumulated sum
+	clc			; initialize carry = 0
+	jcxz	@@done
+@@loop:	lodsw
+	stosw
+	adc	dx,ax
+	loop	@@loop		; loop and stosw leave carry alone
+@@done:	adc	dx,0		; get last carries
+	adc	dx,0
+	mov	ax,dx		; result into ax
+	xchg	al,ah		; byte swap result (8088 is little-endian)
+	ret
+lcsumcpy	endp
+
 ; Link timer handler into timer chain
 ; Arg == address of timer handler routine
 ; MUST be called exactly once before uchtimer is called!
@@ -104,14 +104,9 @@ struct mbuf **bpp	/* Data field */
 		size++;
 		break;
 	}
-	if((*bpp)->next != NULL){
-		/* Copy to contiguous buffer, since driver can't handle mbufs */
-		bp1 = copy_p(*bpp,size);
-		free_p(bpp);
-		*bpp = bp1;
-		if(*bpp == NULL)
-			return -1;
-	}
+	/* The driver can't handle mbuf chains */
+	if(linearize(bpp) == -1)
+		return -1;
 	send_pkt(pp->intno,(*bpp)->data,size);
 	free_p(bpp);
 	return 0;
@@ -146,7 +141,8 @@ unsigned short ax
 		return NULL;	/* Unknown device */
 	switch(ax){
 	case 0:	/* Space allocate call */
-		if((pp->buffer = alloc_mbuf(cx+sizeof(struct iface *))) != NULL){
+		if((pp->buffer = alloc_mbuf_c(&pp->iface->rxcache,
+		 cx+sizeof(struct iface *))) != NULL){
 			pp->buffer->data += sizeof(struct iface *);
 			pp->buffer->cnt = cx;
 			retval = pp->buffer->data;
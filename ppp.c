@@ -397,6 +397,7 @@ void *p2;
 	register int mode = FALSE;
 	register int c;
 
+	setpri( Curproc, PRI_NET );
 	while ( (c = get_asy(dev)) != -1 ) {
 #ifdef PPP_DEBUG_RAW
 		if (ifp->trace & IF_TRACE_RAW) {
@@ -13,8 +13,15 @@
 
 #define	SIGQSIZE	200	/* Entries in ksignal queue */
 
+/* Scheduler priority classes, highest first */
+#define	PRI_NET		0	/* Driver rx/tx, timer and network processes */
+#define	PRI_NORM	1	/* Servers, sessions and everything else */
+#define	PRI_BG		2	/* Background housekeeping */
+#define	NPRI		3
+#define	PRIAGE		8	/* Dispatches a ready process can be passed over */
+
 /* Kernel process control block */
-#define	PHASH	16		/* Number of wait table hash chains */
+#define	PHASH	16		/* Initial number of wait table hash chains */
 struct proc {
 	struct proc *prev;	/* Process table pointers */
 	struct proc *next;	
@@ -40,11 +47,23 @@ struct proc {
 	int iarg;		/* Copy of iarg */
 	void *parg1;		/* Copy of parg1 */
 	void *parg2;		/* Copy of parg2 */
+	int pri;		/* Scheduling priority class, PRI_xxx */
+	int32 rdytime;		/* msclock() when put on the ready list */
+
+	/* CPU accounting, all times in ms */
+	int32 switches;		/* Times dispatched */
+	int32 runstart;		/* msclock() when last dispatched */
+	int32 cputime;		/* Total run time */
+	int32 maxslice;		/* Longest single run between kwaits */
+	int32 waitstart;	/* msclock() when last event wait was posted */
+	int32 lastwait;		/* Time spent blocked on last event */
 };
-extern struct proc *Waittab[];	/* Head of wait list */
-extern struct proc *Rdytab;	/* Head of ready list */
+extern struct proc **Waittab;	/* Heads of wait hash chains */
+extern unsigned Nwaithash;	/* Number of wait hash chains */
+extern unsigned Nwaiting;	/* Number of waiting processes */
+extern struct proc *Rdytab[];	/* Heads of ready lists, one per priority */
 extern struct proc *Curproc;	/* Currently running process */
-extern struct proc *Susptab;	/* Suspended processes */
+extern struct proc *Susptab;	/* Suspended processes not waiting */
 extern int Stkchk;		/* Stack checking flag */
 extern int Kdebug;		/* Control display of current task on screen */
 
@@ -67,6 +86,10 @@ struct ksig {
 	int32 kwaits;		/* Count of kwait calls */
 	int32 kwaitnops;	/* kwait calls that didn't block */
 	int32 kwaitints;	/* kwait calls from interrupt context (error) */
+	int32 ksigscans;	/* Wait chain entries examined by ksig */
+	int32 pruns[NPRI];	/* Dispatches at each priority */
+	int32 prwait[NPRI];	/* Total ms spent on the ready list, same */
+	int32 praged;		/* Dispatches forced by aging */
 };
 extern struct ksig Ksig;
 
@@ -93,6 +116,7 @@ struct proc *newproc(char *name,unsigned int stksize,
 void ksignal(void *event,int n);
 int kwait(void *event);
 void resume(struct proc *pp);
+void setpri(struct proc *pp,int pri);
 int setsig(int val);
 void suspend(struct proc *pp);
 
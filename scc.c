@@ -1290,11 +1290,12 @@ register struct sccchan *scc;
 
 	if((bp = scc->rbp1) == NULL){ /* no buffer available now */
 		if(scc->rbp == NULL){
-			if((bp = alloc_mbuf(scc->bufsiz+sizeof(struct iface *))) != NULL){
+			if((bp = alloc_mbuf_c(&scc->iface->rxcache,
+			 scc->bufsiz+sizeof(struct iface *))) != NULL){
 				scc->rbp = scc->rbp1 = bp;
 				bp->cnt = 0;
 			}
-		} else if((bp = alloc_mbuf(scc->bufsiz)) != NULL){
+		} else if((bp = alloc_mbuf_c(&scc->iface->rxcache,scc->bufsiz)) != NULL){
 			scc->rbp1 = bp;
 			for(bp = scc->rbp; bp->next != NULL; bp = bp->next)
 				;
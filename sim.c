@@ -7,8 +7,17 @@
 #include "timer.h"
 #include "iface.h"
 #include "ip.h"
+#include "cmdparse.h"
+#include "commands.h"
 
 static void simfunc(void *p);
+static int dosimdup(int argc,char *argv[],void *p);
+static int dosimfixed(int argc,char *argv[],void *p);
+static int dosimloss(int argc,char *argv[],void *p);
+static int dosimmaxq(int argc,char *argv[],void *p);
+static int dosimqlimit(int argc,char *argv[],void *p);
+static int dosimstat(int argc,char *argv[],void *p);
+static int dosimxmit(int argc,char *argv[],void *p);
 
 struct pkt {
 	struct timer timer;
@@ -18,55 +27,163 @@ struct pkt {
 struct {
 	int32 fixed;	/* Fixed prop delay, ms */
 	int32 xmit;	/* Xmit time, ms/byte */
-	int32 maxq;	/* Max queueing delay, ms */
+	int32 maxq;	/* Max random queueing delay, ms */
+	int32 qlimit;	/* Max bottleneck queue before drops, ms; 0 = none */
 	int pdup;	/* Probability of duplication, *0.1% */
 	int ploss;	/* Probability of loss, *0.1% */
 } Simctl = {
-	0,0,1000,0,0 };
+	0,0,1000,0,0,0 };
+
+static int32 Simbusy;	/* When the simulated bottleneck goes idle */
+static struct {
+	int32 pkts;	/* Packets offered */
+	int32 lost;	/* Random losses */
+	int32 duped;	/* Duplicates made */
+	int32 qdrops;	/* Dropped on full bottleneck queue */
+	int32 qdelay;	/* Total bottleneck queueing delay, ms */
+} Simstat;
+
+static struct cmds Simcmds[] = {
+	"dup",		dosimdup,	0, 0, NULL,
+	"fixed",	dosimfixed,	0, 0, NULL,
+	"loss",		dosimloss,	0, 0, NULL,
+	"maxq",		dosimmaxq,	0, 0, NULL,
+	"qlimit",	dosimqlimit,	0, 0, NULL,
+	"status",	dosimstat,	0, 0, NULL,
+	"xmit",		dosimxmit,	0, 0, NULL,
+	NULL,
+};
 int
 dosim(argc,argv,p)
 int argc;
-char *argv;
+char *argv[];
 void *p;
 {
+	return subcmd(Simcmds,argc,argv,p);
+}
+static int
+dosimdup(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setint(&Simctl.pdup,"Duplication (0.1%)",argc,argv);
+}
+static int
+dosimfixed(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Simctl.fixed,"Propagation delay (ms)",argc,argv);
+}
+static int
+dosimloss(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setint(&Simctl.ploss,"Loss (0.1%)",argc,argv);
+}
+static int
+dosimmaxq(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Simctl.maxq,"Random queueing delay (ms)",argc,argv);
+}
+static int
+dosimqlimit(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Simctl.qlimit,"Bottleneck queue limit (ms)",argc,argv);
+}
+static int
+dosimxmit(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Simctl.xmit,"Transmission time (ms/byte)",argc,argv);
+}
+static int
+dosimstat(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	printf("Packets %lu lost %lu duped %lu queue drops %lu avg queue %lu ms\n",
+	 Simstat.pkts,Simstat.lost,Simstat.duped,Simstat.qdrops,
+	 Simstat.pkts != 0 ? Simstat.qdelay / Simstat.pkts : 0);
+	if(argc > 1 && strcmp(argv[1],"clear") == 0)
+		memset(&Simstat,0,sizeof(Simstat));
 	return 0;
 }
 
+/* Pass a packet sent to ourselves through the simulated path. When
+ * there's a transmission time, packets are serialized through a single
+ * bottleneck, so a sender that overruns it builds a queue (and, with a
+ * queue limit, loses packets) the way a real slow link would; this is
+ * what makes the TCP congestion control modules behave differently.
+ */
 void
-net_sim(bp)
-struct mbuf *bp;
+net_sim(bpp)
+struct mbuf **bpp;
 {
 	struct pkt *pkt;
-	int32 delay;
+	int32 delay,now,start;
 
+	Simstat.pkts++;
 	if(urandom(1000) < Simctl.ploss){
 		if(Loopback.trfp)
 			fprintf(Loopback.trfp,"packet lost\n");
-		free_p(&bp);	/* Packet is lost */
+		Simstat.lost++;
+		free_p(bpp);	/* Packet is lost */
 		return;
 	}
 	if(urandom(1000) < Simctl.pdup){
 		struct mbuf *dbp;
 		if(Loopback.trfp)
 			fprintf(Loopback.trfp,"packet duped\n");
-		dup_p(&dbp,bp,0,len_p(bp));
-		net_sim(dbp);	/* Packet is duplicated */
+		Simstat.duped++;
+		dup_p(&dbp,*bpp,0,len_p(*bpp));
+		net_sim(&dbp);	/* Packet is duplicated */
 	}
 	/* The simulated network delay for this packet is the sum
-	 * of three factors: a fixed propagation delay, a transmission
-	 * delay proportional to the packet size, and an evenly
+	 * of three factors: a fixed propagation delay, the time spent
+	 * waiting for and being sent over the bottleneck, and an evenly
 	 * distributed random queuing delay up to some maximum
 	 */
-	delay = Simctl.fixed + len_p(bp)*Simctl.xmit + urandom(Simctl.maxq);
+	now = msclock();
+	delay = Simctl.fixed;
+	if(Simctl.xmit != 0){
+		start = Simbusy - now > 0 ? Simbusy : now;
+		if(Simctl.qlimit != 0 && start - now > Simctl.qlimit){
+			if(Loopback.trfp)
+				fprintf(Loopback.trfp,"packet dropped, queue full\n");
+			Simstat.qdrops++;
+			free_p(bpp);
+			return;
+		}
+		Simstat.qdelay += start - now;
+		Simbusy = start + len_p(*bpp)*Simctl.xmit;
+		delay += Simbusy - now;
+	}
+	if(Simctl.maxq != 0)
+		delay += urandom((unsigned)Simctl.maxq);
 	if(Loopback.trfp)
 		fprintf(Loopback.trfp,"packet delayed %ld ms\n",delay);
 	if(delay == 0){
 		/* No delay, return immediately */
-		net_route(&Loopback,&bp);
+		net_route(&Loopback,bpp);
 		return;
 	}
 	pkt = (struct pkt *)mallocw(sizeof(struct pkt));
-	pkt->bp = bp;
+	pkt->bp = *bpp;
+	*bpp = NULL;
 	set_timer(&pkt->timer,delay);
 	pkt->timer.func = simfunc;
 	pkt->timer.arg = pkt;
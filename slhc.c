@@ -185,7 +185,8 @@ int compress_cid;
 	 *  some other control bit is set, or has options).
 	 */
 	if(th.flags.syn || th.flags.fin || th.flags.rst || !th.flags.ack
-	 || th.flags.mss || th.flags.wscale || th.flags.tstamp){
+	 || th.flags.mss || th.flags.wscale || th.flags.tstamp
+	 || th.nsack != 0 || th.flags.sackok){
 		/* TCP connection stuff; send as regular IP */
 		comp->sls_o_tcp++;
 		return SL_TYPE_IP;
@@ -20,6 +20,8 @@
 
 static struct mbuf *slip_decode(struct slip *sp,uint8 c);
 static struct mbuf *slip_encode(struct mbuf **bpp);
+static int slip_stage(struct mbuf **lbpp,struct mbuf **sbpp,uint16 left,
+	uint16 need);
 
 /* Slip level control structure */
 struct slip Slip[SLIP_MAX];
@@ -125,47 +127,100 @@ struct mbuf **bpp
 		raw_dump(iface,-1,bp1);
 	return Slip[iface->xdev].send(iface->dev,&bp1);
 }
-/* Encode a packet in SLIP format */
+/* Encode a packet in SLIP format.
+ *
+ * Runs of ordinary characters at least SLIP_MINDUP long are passed to
+ * the driver by reference with dup_p() instead of being copied; shorter
+ * runs, escape sequences and the framing characters are copied into
+ * small staging mbufs. Since the serial drivers send a chain one mbuf at
+ * a time, the result is a scatter-gather list of the original packet.
+ */
 static
 struct mbuf *
 slip_encode(struct mbuf **bpp)
 {
-	struct mbuf *lbp;	/* Mbuf containing line-ready packet */
+	struct mbuf *lbp = NULL;	/* Line-ready packet */
+	struct mbuf *sbp = NULL;	/* Current staging mbuf */
+	struct mbuf *bp,*dbp;
 	register uint8 *cp;
-	int c;
-
-	/* Allocate output mbuf that's twice as long as the packet.
-	 * This is a worst-case guess (consider a packet full of FR_ENDs!)
-	 */
-	lbp = alloc_mbuf((uint16)(2*len_p(*bpp) + 2));
-	if(lbp == NULL){
-		/* No space; drop */
-		free_p(bpp);
-		return NULL;
-	}
-	cp = lbp->data;
+	uint8 *ep,*rp;
+	uint16 n,left;
 
+	left = len_p(*bpp);
 	/* Flush out any line garbage */
-	*cp++ = FR_END;
+	if(slip_stage(&lbp,&sbp,left,2) == -1)
+		goto nospace;
+	sbp->data[sbp->cnt++] = FR_END;
 
-	/* Copy input to output, escaping special characters */
-	while((c = PULLCHAR(bpp)) != -1){
-		switch(c){
-		case FR_ESC:
-			*cp++ = FR_ESC;
-			*cp++ = T_FR_ESC;
-			break;
-		case FR_END:
-			*cp++ = FR_ESC;
-			*cp++ = T_FR_END;
-			break;
-		default:
-			*cp++ = c;
+	for(bp = *bpp;bp != NULL;bp = bp->next){
+		cp = bp->data;
+		ep = cp + bp->cnt;
+		while(cp < ep){
+			/* Find the end of the run of ordinary characters */
+			for(rp = cp;rp < ep && *rp != FR_END && *rp != FR_ESC;rp++)
+				;
+			n = rp - cp;
+			left -= n;
+			if(n >= SLIP_MINDUP){
+				/* Long enough to send in place */
+				if(dup_p(&dbp,bp,(uint16)(cp - bp->data),n) != n){
+					free_p(&dbp);
+					goto nospace;
+				}
+				append(&lbp,&sbp);
+				append(&lbp,&dbp);
+			} else while(n != 0){
+				if(slip_stage(&lbp,&sbp,left+n,1) == -1)
+					goto nospace;
+				rp = cp + min(n,sbp->size - sbp->cnt);
+				memcpy(sbp->data + sbp->cnt,cp,rp - cp);
+				sbp->cnt += rp - cp;
+				n -= rp - cp;
+				cp = rp;
+			}
+			cp = rp;
+			if(cp == ep)
+				break;
+			/* Escape the special character */
+			left--;
+			if(slip_stage(&lbp,&sbp,left,2) == -1)
+				goto nospace;
+			sbp->data[sbp->cnt++] = FR_ESC;
+			sbp->data[sbp->cnt++] = (*cp++ == FR_END) ? T_FR_END : T_FR_ESC;
 		}
 	}
-	*cp++ = FR_END;
-	lbp->cnt = cp - lbp->data;
+	if(slip_stage(&lbp,&sbp,0,1) == -1)
+		goto nospace;
+	sbp->data[sbp->cnt++] = FR_END;
+	append(&lbp,&sbp);
+	free_p(bpp);	/* The dups hold their own references */
 	return lbp;
+
+nospace:
+	/* No space; drop */
+	free_p(&sbp);
+	free_p(&lbp);
+	free_p(bpp);
+	return NULL;
+}
+/* Make sure the current SLIP staging mbuf has room for at least 'need'
+ * more bytes, closing it out onto the output chain and starting another
+ * if it doesn't. 'left' is the number of packet bytes yet to be encoded,
+ * used to size the new mbuf. Return -1 if out of memory.
+ */
+static int
+slip_stage(
+struct mbuf **lbpp,
+struct mbuf **sbpp,
+uint16 left,
+uint16 need
+){
+	if(*sbpp != NULL && (*sbpp)->size - (*sbpp)->cnt >= need)
+		return 0;
+	append(lbpp,sbpp);
+	if((*sbpp = alloc_mbuf(min(2*left + 2,SLIP_STAGE))) == NULL)
+		return -1;
+	return 0;
 }
 /* Process incoming bytes in SLIP format
  * When a buffer is complete, return it; otherwise NULL
@@ -250,6 +305,7 @@ void *p2;
 
 	sp = &Slip[xdev];
 	cdev = sp->iface->dev;
+	setpri(Curproc,PRI_NET);
 
 	while ( (c = sp->get(cdev)) != -1 ) {
 		if((bp = slip_decode(sp,c)) == NULL)
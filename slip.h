@@ -21,6 +21,8 @@
  * Make this match the medium mbuf size in mbuf.h for best performance
  */
 #define	SLIP_ALLOC	128
+#define	SLIP_MINDUP	64	/* Shortest run sent without copying */
+#define	SLIP_STAGE	256	/* Largest staging mbuf for escapes */
 
 #define	FR_END		0300	/* Frame End */
 #define	FR_ESC		0333	/* Frame Escape */
@@ -19,6 +19,8 @@
 
 char *Rempass = "";	/* Remote access password */
 
+#define	REMBATCH	8	/* Datagrams taken per receive call */
+
 static int chkrpass(struct mbuf *bp);
 static void discserv(int s,void *unused,void *p);
 static void echoserv(int s,void *unused,void *p);
@@ -139,7 +141,8 @@ char *argv[];
 void *p;
 {
 	struct sockaddr_in lsocket,fsock;
-	int i;
+	struct mmsg msgs[REMBATCH];
+	int i,j,n;
 	int command;
 	struct mbuf *bp;
 	int32 addr;
@@ -159,10 +162,15 @@ void *p;
 	
 	Rem = socket(AF_INET,SOCK_DGRAM,0);
 	bind(Rem,(struct sockaddr *)&lsocket,sizeof(lsocket));
-	for(;;){
-		i = sizeof(fsock);
-		if(recv_mbuf(Rem,&bp,0,(struct sockaddr *)&fsock,&i) == -1)
-			break;
+	for(j = n = 0;;j++){
+		if(j == n){
+			/* Take whatever commands have arrived in one call */
+			if((n = recv_mmsg(Rem,msgs,REMBATCH,0)) == -1)
+				break;
+			j = 0;
+		}
+		bp = msgs[j].bp;
+		memcpy(&fsock,&msgs[j].name,sizeof(fsock));
 		command = PULLCHAR(&bp);
 
 		switch(command){
@@ -424,7 +432,8 @@ char *argv[];
 void *p;
 {
 	struct sockaddr_in lsocket,fsock;
-	int i,c;
+	struct mmsg msgs[REMBATCH];
+	int i,j,n,c;
 	struct mbuf *bp;
 	char *cp;
 	uint8 *dp;
@@ -452,10 +461,14 @@ void *p;
 	bind(Bsr,(struct sockaddr *)&lsocket,sizeof(lsocket));
 
 	/* Process commands */
-	for(;;){
-		i = sizeof(fsock);
-		if(recv_mbuf(Bsr,&bp,0,(struct sockaddr *)&fsock,&i) == -1)
-			break;
+	for(j = n = 0;;j++){
+		if(j == n){
+			if((n = recv_mmsg(Bsr,msgs,REMBATCH,0)) == -1)
+				break;
+			j = 0;
+		}
+		bp = msgs[j].bp;
+		memcpy(&fsock,&msgs[j].name,sizeof(fsock));
 		/* Check password */
 		for(cp = Rempass;;cp++){
 			c = PULLCHAR(&bp);
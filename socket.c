@@ -346,6 +346,50 @@ int *fromlen		/* Length of peer address */
 	}
 	return (*sp->recv)(up,bpp,from,fromlen);
 }
+/* Receive up to n messages in one call. Only the first is waited for
+ * (unless the socket is nonblocking); the rest are whatever is already
+ * queued, so a busy datagram server can take a burst for the price of
+ * one socket lookup and one wakeup. Returns the number of messages
+ * received, or -1 if none.
+ */
+int
+recv_mmsg(
+int s,			/* Socket index */
+struct mmsg *msgs,	/* Messages to fill in */
+int n,			/* Size of msgs[] */
+int flags		/* Unused */
+){
+	register struct usock *up;
+	struct socklink *sp;
+	register struct mmsg *mp;
+	int i,noblock;
+
+	if((up = itop(s)) == NULL){
+		errno = EBADF;
+		return -1;
+	}
+	sp = up->sp;
+	if(sp->recv == NULL){
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+	noblock = up->noblock;
+	for(i=0,mp=msgs;i<n;i++,mp++){
+		mp->namelen = sizeof(mp->name);
+		if((mp->len = (*sp->recv)(up,&mp->bp,&mp->name,&mp->namelen)) == -1)
+			break;
+		up->noblock = 1;	/* Don't wait for any more */
+		if(mp->len == 0){
+			i++;		/* End of file; don't keep reading it */
+			break;
+		}
+	}
+	up->noblock = noblock;
+	if(i == 0)
+		return -1;
+	errno = 0;
+	return i;
+}
 /* Low level send routine; user supplies mbuf for transmission. More
  * efficient than send() or sendto(), the higher level interfaces.
  * The "to" and "tolen" parameters are ignored on connection-oriented
@@ -392,6 +436,48 @@ int tolen		/* Length of destination */
 	}
 	return cnt;
 }
+/* Send n messages in one call; a message with a namelen of 0 goes to
+ * the connected peer. Every buffer is consumed, even on error. Returns
+ * the number of messages sent, or -1 if none.
+ */
+int
+send_mmsg(
+int s,			/* Socket index */
+struct mmsg *msgs,	/* Messages to send */
+int n,			/* Count of same */
+int flags		/* Unused */
+){
+	register struct usock *up;
+	struct socklink *sp;
+	register struct mmsg *mp;
+	struct sockaddr *to;
+	int i;
+
+	if((up = itop(s)) == NULL){
+		errno = EBADF;
+		i = 0;
+	} else if((sp = up->sp)->send == NULL){
+		errno = EOPNOTSUPP;
+		i = 0;
+	} else {
+		for(i=0,mp=msgs;i<n;i++,mp++){
+			to = mp->namelen != 0 ? &mp->name : NULL;
+			if(to != NULL && sp->check != NULL
+			 && (*sp->check)(to,mp->namelen) == -1){
+				errno = EAFNOSUPPORT;
+				break;
+			}
+			if((mp->len = (*sp->send)(up,&mp->bp,to)) == -1){
+				errno = EOPNOTSUPP;
+				break;
+			}
+		}
+	}
+	/* Free whatever wasn't sent */
+	for(mp = &msgs[i];mp < &msgs[n];mp++)
+		free_p(&mp->bp);
+	return i == 0 ? -1 : i;
+}
 /* Return local name passed in an earlier bind() call */
 int
 getsockname(
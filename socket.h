@@ -79,6 +79,14 @@
 
 extern char *Sock_errlist[];
 
+/* One message for recv_mmsg() and send_mmsg() */
+struct mmsg {
+	struct mbuf *bp;	/* Data */
+	struct sockaddr name;	/* Peer address */
+	int namelen;		/* Length of same; 0 on send means connected peer */
+	int len;		/* Length received, or send result */
+};
+
 /* In socket.c: */
 extern int Axi_sock;	/* Socket listening to AX25 (there can be only one) */
 
@@ -92,7 +100,9 @@ int getpeername(int s,struct sockaddr *peername,int *peernamelen);
 int getsockname(int s,struct sockaddr *name,int *namelen);
 int listen(int s,int backlog);
 int recv_mbuf(int s,struct mbuf **bpp,int flags,struct sockaddr *from,int *fromlen);
+int recv_mmsg(int s,struct mmsg *msgs,int n,int flags);
 int send_mbuf(int s,struct mbuf **bp,int flags,struct sockaddr *to,int tolen);
+int send_mmsg(int s,struct mmsg *msgs,int n,int flags);
 int settos(int s,int tos);
 int shutdown(int s,int how);
 int socket(int af,int type,int protocol);
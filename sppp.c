@@ -69,9 +69,9 @@ struct iface *iface,
 int protocol,
 struct mbuf **bpp
 ){
-	struct mbuf *obp;
-	uint8 *cp;
-	int c;
+	struct mbuf *obp,*bp;
+	uint8 *cp,*ip;
+	uint16 cnt;
 	uint16 fcs;
 
 	fcs = FCS_START;
@@ -80,11 +80,14 @@ struct mbuf **bpp
 	*cp++ = HDLC_FLAG;
 	cp = putbyte(cp,(char)protocol);
 	fcs = FCS(fcs,protocol);
-	while((c = PULLCHAR(bpp)) != -1){
-		fcs = FCS(fcs,c);
-		cp = putbyte(cp,c);
+	/* Work directly on each segment rather than pulling a byte at a time */
+	for(bp = *bpp;bp != NULL;bp = bp->next){
+		for(ip = bp->data,cnt = bp->cnt;cnt != 0;ip++,cnt--){
+			fcs = FCS(fcs,*ip);
+			cp = putbyte(cp,*ip);
+		}
 	}
-	free_p(bpp);	/* Shouldn't be necessary */
+	free_p(bpp);
 	fcs ^= 0xffff;
 	cp = putbyte(cp,fcs);
 	cp = putbyte(cp,fcs >> 8);
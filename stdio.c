@@ -838,6 +838,70 @@ FILE *fp
 		ksignal(&fp->obuf,1);
 	return n;
 }
+/* Move up to cnt bytes (0 means until EOF) from one stream to another
+ * by handing the input buffers themselves to the output side, so what
+ * arrives on a socket goes straight onto the other socket's send queue,
+ * and file data read into an mbuf is queued for sending without being
+ * copied again. Only binary streams onto a socket or pipe can be spliced;
+ * for anything else (newline translation, or a file as output, which
+ * is better written in whole blocks) this fails with EINVAL and the
+ * caller should use its own fread()/fwrite() loop. Returns the count
+ * moved, or -1 on an error.
+ */
+long
+fsplice(
+FILE *in,
+FILE *out,
+long cnt
+){
+	struct mbuf *bp;
+	long tot = 0;
+	uint16 n;
+
+	if(in == NULL || in->cookie != _COOKIE
+	 || out == NULL || out->cookie != _COOKIE)
+		return -1;
+	if(in->flags.ascii || out->flags.ascii
+	 || (out->type != _FL_SOCK && out->type != _FL_PIPE)){
+		errno = EINVAL;
+		return -1;
+	}
+	fflush(in);
+	if(fflush(out) == EOF)
+		return -1;	/* Keep what was already written in order */
+	while(cnt == 0 || tot < cnt){
+		if(in->ibuf == NULL){
+			if(tot != 0 && in->flags.partread)
+				break;	/* Would block for more data */
+			if(_fillbuf(in,BUFSIZ) == NULL)
+				break;	/* eof or error */
+		}
+		n = len_p(in->ibuf);
+		if(cnt != 0 && cnt - tot < n){
+			/* Take only part of the input buffer */
+			n = cnt - tot;
+			if(dup_p(&bp,in->ibuf,0,n) != n){
+				/* Out of mbuf headers; copy it */
+				free_p(&bp);
+				bp = ambufw(n);
+				bp->cnt = pullup(&in->ibuf,bp->data,n);
+			} else
+				pullup(&in->ibuf,NULL,n);
+		} else {
+			bp = in->ibuf;
+			in->ibuf = NULL;
+		}
+		if(in->type == _FL_PIPE)
+			ksignal(&in->obuf,1);
+		out->obuf = bp;
+		if(fflush(out) == EOF){
+			out->flags.err = 1;
+			return -1;
+		}
+		tot += n;
+	}
+	return tot;
+}
 void
 perror(const char *s)
 {
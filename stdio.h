@@ -102,6 +102,7 @@ int fputs(char *buf,FILE *fp);
 size_t fread(void *ptr,size_t size,size_t n,FILE *fp);
 FILE *freopen(char *name,char *mode,FILE *fp);
 int fseek(FILE *fp,long offset,int whence);
+long fsplice(FILE *in,FILE *out,long cnt);
 long ftell(FILE *fp);
 size_t fwrite(void *ptr,size_t size,size_t n,FILE *fp);
 char *gets(char *s);
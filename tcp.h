@@ -36,7 +36,6 @@
 #define	DEF_RTT	5000	/* Initial guess at round trip time (5 sec) */
 #define	MSL2	30	/* Guess at two maximum-segment lifetimes */
 #define	MIN_RTO	500L	/* Minimum timeout, milliseconds */
-#define	TCP_HDR_PAD	70	/* mbuf size to preallocate for headers */
 #define	DEF_WSCALE	0	/* Our window scale option */
 
 #define	geniss()	((int32)msclock() << 12) /* Increment clock at 4 MB/sec */
@@ -57,6 +56,15 @@
  */
 #define TCPLEN		20	/* Minimum Header length, bytes */
 #define	TCP_MAXOPT	40	/* Largest option field, bytes */
+#define	MAXSACK		4	/* Most SACK blocks that fit in an option */
+#define	TCPSACKSB	8	/* Ranges kept in the sender's SACK scoreboard */
+#define	TCP_BULKSEGS	4	/* Full-sized segments in a row that mean bulk data */
+
+/* A range of sequence numbers, start inclusive, end exclusive */
+struct sackblk {
+	int32 start;
+	int32 end;
+};
 struct tcp {
 	uint16 source;	/* Source port */
 	uint16 dest;	/* Destination port */
@@ -69,6 +77,8 @@ struct tcp {
 	uint8 wsopt;			/* Optional window scale factor */
 	uint32 tsval;			/* Outbound timestamp */
 	uint32 tsecr;			/* Timestamp echo field */
+	int nsack;			/* Count of SACK blocks */
+	struct sackblk sack[MAXSACK];	/* SACK blocks */
 	struct {
 		unsigned int congest:1;	/* Echoed IP congestion experienced bit */
 		unsigned int urg:1;
@@ -80,6 +90,7 @@ struct tcp {
 		unsigned int mss:1;	/* MSS option present */
 		unsigned int wscale:1;	/* Window scale option present */
 		unsigned int tstamp:1;	/* Timestamp option present */
+		unsigned int sackok:1;	/* SACK-permitted option present */
 	} flags;
 };
 /* TCP options */
@@ -91,15 +102,25 @@ struct tcp {
 #define	WSCALE_LENGTH	3
 #define	TSTAMP_KIND	8
 #define	TSTAMP_LENGTH	10
+#define	SACKOK_KIND	4
+#define	SACKOK_LENGTH	2
+#define	SACK_KIND	5
+#define	SACK_LENGTH(n)	(2 + 8*(n))
 
 /* Resequencing queue entry */
+/* Out-of-order data is kept as a sorted list of disjoint sequence
+ * ranges; a segment that overlaps or abuts a range is trimmed and merged
+ * into it as it arrives
+ */
 struct reseq {
-	struct reseq *next;	/* Linked-list pointer */
-	struct tcp seg;		/* TCP header */
-	struct mbuf *bp;	/* data */
-	uint16 length;		/* data length */
-	char tos;		/* Type of service */
+	struct reseq *next;	/* Next higher range */
+	int32 seq;		/* First sequence number */
+	int32 end;		/* Just past the last data byte */
+	struct mbuf *bp;	/* Data */
+	struct mbuf *tail;	/* Last mbuf of same */
+	char fin;		/* A FIN follows the data */
 };
+#define	RESEQMAX	32768L	/* Largest range kept in one entry */
 /* These numbers match those defined in the MIB for TCP connection state */
 enum tcp_state {
 	TCP_CLOSED=1,
@@ -115,9 +136,23 @@ enum tcp_state {
 	TCP_TIME_WAIT,
 };
 
+/* Congestion control module, see tcpcc.c */
+struct tcb;
+struct tcp_cc {
+	char *name;
+	void (*init)(struct tcb *tcb);	/* Connection synchronized */
+	void (*ack)(struct tcb *tcb,int32 acked,int32 rtt);
+		/* New data acked; rtt < 0 if there's no sample */
+	void (*loss)(struct tcb *tcb);	/* Fast retransmit; set ssthresh */
+	void (*rto)(struct tcb *tcb);	/* Timeout or quench; also cut cwind */
+	int32 (*rate)(struct tcb *tcb);	/* Pacing rate, bytes/sec, 0 if none */
+};
+
 /* TCP connection control block */
 struct tcb {
-	struct tcb *next;	/* Linked list pointer */
+	struct tcb *next;	/* Linked list pointers */
+	struct tcb *prev;
+	struct tcb *hnext;	/* Hash chain pointer */
 
 	struct connection conn;
 
@@ -149,6 +184,12 @@ struct tcb {
 	int32 cwind;		/* Congestion window */
 	int32 ssthresh;		/* Slow-start threshold */
 	int dupacks;		/* Count of duplicate (do-nothing) ACKs */
+	struct tcp_cc *cc;	/* Congestion control module */
+	int32 ccwmax;		/* cubic: window before last reduction */
+	int32 ccepoch;		/* Start of current growth epoch, ms */
+	int32 cck;		/* cubic: time to regain ccwmax, 1/64 sec */
+	int32 minrtt;		/* Least recent round trip time, ms */
+	int32 mintime;		/* When it was measured */
 
 	/* Receive sequence variables */
 	struct {
@@ -183,6 +224,9 @@ struct tcb {
 		unsigned int congest:1;	/* Copy of last IP congest bit received */
 		int ts_ok:1;	/* We're using timestamps */
 		int ws_ok:1;		/* We're using window scaling */
+		unsigned int sack_ok:1;	/* We're using selective acks */
+		unsigned int ccset:1;	/* Congestion control chosen by user */
+		unsigned int rclosed:1;	/* User will read no more data */
 	} flags;
 	char tos;		/* Type of service (for IP) */
 	int backoff;		/* Backoff interval */
@@ -196,7 +240,26 @@ struct tcb {
 				 */
 
 	struct reseq *reseq;	/* Out-of-order segment queue */
+	int32 sackin;		/* Start of latest out-of-order arrival */
+
+	/* Sender's scoreboard of data the peer has selectively acked,
+	 * sorted and disjoint, all above snd.una
+	 */
+	struct sackblk sacked[TCPSACKSB];
+	int nsacked;
+	int32 recover;		/* snd.nxt when fast recovery began */
+	int32 rexmt;		/* Next sequence to search for holes */
+	int32 sackbytes;	/* Bytes resent from scoreboard holes */
 	struct timer timer;	/* Retransmission timer */
+	struct timer pacer;	/* Pacing timer */
+	int32 pacenext;		/* Earliest time for next new segment, ms */
+	int32 pacerate;		/* Last pacing rate, bytes/sec */
+	int32 paced;		/* Segments held back by pacing */
+	int maxburst;		/* Most segments sent back to back */
+	struct timer acker;	/* Delayed ACK timer */
+	int32 ackpend;		/* Bytes received but not yet acked */
+	int ackbulk;		/* Consecutive full-sized segments received */
+	int32 ackheld;		/* ACKs held back for delayed acking */
 	int32 rtt_time;		/* Stored clock values for RTT */
 	int32 rttseq;		/* Sequence number being timed */
 	int32 rttack;		/* Ack at start of timing (for txbw calc) */
@@ -215,6 +278,20 @@ struct tcb {
 	int32 lastrx;		/* Time of last received data */
 	int32 rxbw;		/* Estimate of receive bandwidth */
 };
+/* Compact record of a connection in TIME_WAIT, kept in place of its TCB */
+struct tcptw {
+	struct tcptw *next;	/* Expiration list, oldest first */
+	struct tcptw *prev;
+	struct tcptw *hnext;	/* Hash chain pointer */
+	struct connection conn;
+	int32 snd_nxt;		/* Our final sequence number */
+	int32 rcv_nxt;		/* Peer's final sequence number */
+	int32 expires;		/* msclock() time at which record expires */
+	int32 ts_recent;	/* Most recent incoming timestamp */
+	uint16 wnd;		/* Receive window, scaled as sent */
+	char tos;		/* Type of service (for IP) */
+	char ts_ok;		/* We're using timestamps */
+};
 /* TCP round-trip time cache */
 struct tcp_rtt {
 	int32 addr;		/* Destination IP address */
@@ -251,11 +328,31 @@ extern struct mib_entry Tcp_mib[];
 #define	NUMTCPMIB	15
 
 extern struct tcb *Tcbs;
+extern unsigned Ntcbs;		/* Control blocks on Tcbs */
+extern unsigned Ntcbhash;	/* Chains in connection hash table */
+extern int32 Tcblookups;	/* Calls to lookup_tcb() */
+extern int32 Tcbprobes;		/* Hash chain entries examined by same */
+extern int32 Tcptimeouts;	/* Retransmission timeouts, all connections */
+extern int32 Tcpsackout;	/* SACK blocks sent */
+extern int32 Tcpsackin;		/* SACK blocks received */
+extern int32 Tcpsackholes;	/* Retransmissions of scoreboard holes */
+extern int32 Tcpsackbytes;	/* Bytes in same */
+extern int32 Tcpsackrecov;	/* Fast recoveries completed using SACK */
+extern int32 Tcppaced;		/* Segments held back by pacing */
+extern int32 Tcpackheld;	/* ACKs held back for delayed acking */
+extern int32 Tcpacktimer;	/* Delayed ACKs sent on timer expiry */
+extern int32 Tcpackcarry;	/* Delayed ACKs carried by outgoing data */
+extern int32 Tcpackstretch;	/* ACKs covering more than Tcp_ackevery segs */
 extern char *Tcpstates[];
 extern char *Tcpreasons[];
 
 /* In tcpcmd.c: */
 extern int Tcp_tstamps;
+extern int Tcp_sack;
+extern int Tcp_pace;
+extern int32 Tcp_ackdelay;
+extern int Tcp_ackevery;
+extern int Tcp_ackstretch;
 extern int32 Tcp_irtt;
 extern uint16 Tcp_limit;
 extern uint16 Tcp_mss;
@@ -265,6 +362,12 @@ extern uint16 Tcp_window;
 
 void st_tcp(struct tcb *tcb);
 
+/* In tcpcc.c: */
+extern struct tcp_cc *Tcp_ccs[];
+extern struct tcp_cc *Tcp_cc;
+struct tcp_cc *tcp_ccfind(char *name);
+void tcp_ccinit(struct tcb *tcb,struct tcp_cc *cc);
+
 /* In tcphdr.c: */
 void htontcp(struct tcp *tcph,struct mbuf **data,
 	int32 ipsrc,int32 ipdest);
@@ -281,7 +384,10 @@ void tcp_icmp(int32 icsource,int32 source,int32 dest,
 /* In tcpsubr.c: */
 void close_self(struct tcb *tcb,int reason);
 struct tcb *create_tcb(struct connection *conn);
+void tcb_timers(struct tcb *tcb);
 struct tcb *lookup_tcb(struct connection *conn);
+void link_tcb(struct tcb *tcb);
+int unlink_tcb(struct tcb *tcb);
 void rtt_add(int32 addr,int32 rtt);
 struct tcp_rtt *rtt_get(int32 addr);
 int seq_ge(int32 x,int32 y);
@@ -294,10 +400,24 @@ void tcp_garbage(int red);
 
 /* In tcpout.c: */
 void tcp_output(struct tcb *tcb);
+void tcp_pacer(void *p);
+
+/* In tcptw.c: */
+extern unsigned Ntcptw;
+extern int32 Tcptwmax;
+extern int32 Tcptws;
+extern int32 Tcptwacks;
+extern int32 Tcptwreuse;
+extern int32 Tcptwdrops;
+void tcp_timewait(struct tcb *tcb);
+int tcp_twinput(struct tcp *seg,struct connection *conn,
+	struct mbuf **bpp,uint16 length);
+void tcp_twgarbage(int red);
 
 /* In tcptimer.c: */
 int32 backoff(int n);
 void tcp_timeout(void *p);
+void tcp_acker(void *p);
 
 /* In tcpuser.c: */
 int close_tcp(struct tcb *tcb);
@@ -0,0 +1,273 @@
+/* TCP congestion control modules. The generic machinery in tcpin.c
+ * (duplicate ack counting, fast retransmit and recovery, window
+ * inflation and clamping) calls through tcb->cc to decide how the
+ * congestion window grows on new acks and how far it is cut on loss.
+ *
+ *  newreno - Van Jacobson slow start and congestion avoidance
+ *  cubic   - Window grows as a cubic function of time since the last loss
+ *  delay   - Backs off as queueing delay builds, before there's loss
+ *
+ * Copyright 1991 Phil Karn, KA9Q
+ */
+#include "global.h"
+#include "timer.h"
+#include "mbuf.h"
+#include "netuser.h"
+#include "internet.h"
+#include "tcp.h"
+#include "ip.h"
+
+static void reno_ack(struct tcb *tcb,int32 acked,int32 rtt);
+static void reno_loss(struct tcb *tcb);
+static void reno_rto(struct tcb *tcb);
+static void cubic_init(struct tcb *tcb);
+static void cubic_ack(struct tcb *tcb,int32 acked,int32 rtt);
+static void cubic_loss(struct tcb *tcb);
+static void cubic_rto(struct tcb *tcb);
+static void delay_init(struct tcb *tcb);
+static void delay_ack(struct tcb *tcb,int32 acked,int32 rtt);
+static void delay_loss(struct tcb *tcb);
+static void delay_rto(struct tcb *tcb);
+static int32 delay_rate(struct tcb *tcb);
+static int32 icbrt(uint32 x);
+
+static struct tcp_cc Newreno = {
+	"newreno",	NULL,	reno_ack,	reno_loss,	reno_rto,	NULL,
+};
+static struct tcp_cc Cubic = {
+	"cubic",	cubic_init,	cubic_ack,	cubic_loss,	cubic_rto,	NULL,
+};
+static struct tcp_cc Delay = {
+	"delay",	delay_init,	delay_ack,	delay_loss,	delay_rto,	delay_rate,
+};
+struct tcp_cc *Tcp_ccs[] = {
+	&Newreno,
+	&Cubic,
+	&Delay,
+	NULL,
+};
+struct tcp_cc *Tcp_cc = &Newreno;	/* Default for new connections */
+
+/* Look up a congestion control module by name */
+struct tcp_cc *
+tcp_ccfind(
+char *name
+){
+	struct tcp_cc **ccp;
+
+	for(ccp = Tcp_ccs;*ccp != NULL;ccp++)
+		if(strcmp((*ccp)->name,name) == 0)
+			return *ccp;
+	return NULL;
+}
+/* Select a connection's congestion control module and start it */
+void
+tcp_ccinit(
+struct tcb *tcb,
+struct tcp_cc *cc
+){
+	tcb->cc = cc;
+	tcb->ccwmax = tcb->ccepoch = tcb->cck = 0;
+	tcb->minrtt = tcb->mintime = 0;
+	if(cc->init != NULL)
+		(*cc->init)(tcb);
+}
+
+/* NewReno: exponential growth to ssthresh, then one segment per RTT */
+static void
+reno_ack(
+struct tcb *tcb,
+int32 acked,
+int32 rtt
+){
+	if(tcb->cwind >= tcb->snd.wnd)
+		return;
+	if(tcb->cwind < tcb->ssthresh){
+		/* Still doing slow start/CUTE, expand by amount acked */
+		tcb->cwind += min(acked,tcb->mss);
+	} else {
+		/* Steady-state test of extra path capacity */
+		tcb->cwind += ((long)tcb->mss * tcb->mss) / tcb->cwind;
+	}
+}
+static void
+reno_loss(
+struct tcb *tcb
+){
+	tcb->ssthresh = tcb->cwind/2;
+	tcb->ssthresh = max(tcb->ssthresh,tcb->mss);
+}
+static void
+reno_rto(
+struct tcb *tcb
+){
+	reno_loss(tcb);
+	tcb->cwind = tcb->mss;	/* Restart slow start */
+}
+
+/* CUBIC (RFC 8312) with C = 0.4 and beta = 0.7. Time is kept in units
+ * of 1/64 sec so the cube of the time since the last loss fits in
+ * 32 bits for up to 16 seconds; after that growth is a steady cubic
+ * tail. Never grows more slowly than NewReno would.
+ */
+#define	CUBIC_HZ	64	/* Time units per second */
+#define	CUBIC_MAXT	1000	/* Largest time offset used, CUBIC_HZ units */
+
+static void
+cubic_init(
+struct tcb *tcb
+){
+	tcb->ccwmax = tcb->cwind;
+}
+static void
+cubic_ack(
+struct tcb *tcb,
+int32 acked,
+int32 rtt
+){
+	int32 t,target,inc;
+	uint32 cube;
+
+	if(tcb->cwind < tcb->ssthresh){
+		reno_ack(tcb,acked,rtt);
+		return;
+	}
+	if(tcb->ccepoch == 0){
+		/* First ack of this congestion avoidance epoch */
+		tcb->ccepoch = msclock();
+		if(tcb->ccwmax <= tcb->cwind){
+			tcb->ccwmax = tcb->cwind;
+			tcb->cck = 0;
+		} else {
+			/* K = cbrt(Wmax*(1-beta)/C), Wmax in segments */
+			t = min(tcb->ccwmax / tcb->mss,16384);
+			cube = (uint32)t * 196608L
+			 + ((uint32)(tcb->ccwmax % tcb->mss) * 196608L) / tcb->mss;
+			tcb->cck = icbrt(cube);
+		}
+	}
+	/* W(t) = C*(t-K)^3 + Wmax */
+	t = ((msclock() - tcb->ccepoch) * CUBIC_HZ) / 1000 - tcb->cck;
+	if(t > CUBIC_MAXT)
+		t = CUBIC_MAXT;
+	else if(t < -CUBIC_MAXT)
+		t = -CUBIC_MAXT;
+	cube = (uint32)(t < 0 ? -t : t);
+	cube = cube * cube * cube / 640;	/* C/CUBIC_HZ^3, in 1/1024 segs */
+	inc = (int32)((cube * (uint32)(tcb->mss >> 2)) >> 8);
+	target = t < 0 ? tcb->ccwmax - inc : tcb->ccwmax + inc;
+
+	/* Close 1/cwind of the gap per ack, but at least as fast as Reno */
+	inc = ((long)tcb->mss * tcb->mss) / tcb->cwind;
+	if(target > tcb->cwind)
+		inc = max(inc,(target - tcb->cwind) / max(tcb->cwind / tcb->mss,1));
+	tcb->cwind += inc;
+}
+static void
+cubic_loss(
+struct tcb *tcb
+){
+	tcb->ccwmax = tcb->cwind;
+	tcb->ccepoch = 0;
+	tcb->ssthresh = (tcb->cwind * 7) / 10;
+	tcb->ssthresh = max(tcb->ssthresh,2*tcb->mss);
+}
+static void
+cubic_rto(
+struct tcb *tcb
+){
+	cubic_loss(tcb);
+	tcb->cwind = tcb->mss;
+}
+/* Integer cube root, rounded down */
+static int32
+icbrt(
+uint32 x
+){
+	uint32 lo,hi,mid;
+
+	lo = 0;
+	hi = 1625;	/* Largest cube that fits in 32 bits */
+	while(lo < hi){
+		mid = (lo + hi + 1) / 2;
+		if(mid * mid * mid <= x)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return (int32)lo;
+}
+
+/* Delay based: compare each RTT with the least seen recently. Once per
+ * RTT, add a segment if fewer than DELAY_ALPHA segments are queued in
+ * the path, take one away if more than DELAY_BETA are. Random loss on
+ * radio links costs only a small cut. The pacing rate is the window
+ * delivered over the uncongested RTT.
+ */
+#define	DELAY_ALPHA	2	/* Segments queued, lower target */
+#define	DELAY_BETA	4	/* Segments queued, upper target */
+#define	DELAY_MINAGE	10000L	/* Forget the minimum RTT after this, ms */
+
+static void
+delay_init(
+struct tcb *tcb
+){
+	tcb->ccepoch = msclock();
+}
+static void
+delay_ack(
+struct tcb *tcb,
+int32 acked,
+int32 rtt
+){
+	int32 now,queued;
+
+	now = msclock();
+	if(rtt < 0)
+		return;		/* No sample to judge by */
+	if(rtt == 0)
+		rtt = 1;
+	if(tcb->minrtt == 0 || rtt < tcb->minrtt
+	 || now - tcb->mintime > DELAY_MINAGE){
+		tcb->minrtt = rtt;
+		tcb->mintime = now;
+	}
+	if(now - tcb->ccepoch < tcb->srtt)
+		return;		/* Adjust only once per RTT */
+	tcb->ccepoch = now;
+
+	/* Segments sitting in queues = window * (1 - minrtt/rtt) */
+	queued = ((tcb->cwind / tcb->mss) * (rtt - tcb->minrtt)) / rtt;
+	if(tcb->cwind < tcb->ssthresh && queued < 1){
+		tcb->cwind *= 2;	/* Slow start while there's no queue */
+	} else {
+		if(tcb->cwind < tcb->ssthresh)
+			tcb->ssthresh = tcb->cwind;	/* Queue found */
+		if(queued < DELAY_ALPHA)
+			tcb->cwind += tcb->mss;
+		else if(queued > DELAY_BETA)
+			tcb->cwind -= tcb->mss;
+	}
+	tcb->cwind = max(tcb->cwind,2*tcb->mss);
+}
+static void
+delay_loss(
+struct tcb *tcb
+){
+	tcb->ssthresh = (tcb->cwind * 7) / 8;
+	tcb->ssthresh = max(tcb->ssthresh,2*tcb->mss);
+}
+static void
+delay_rto(
+struct tcb *tcb
+){
+	reno_rto(tcb);
+}
+static int32
+delay_rate(
+struct tcb *tcb
+){
+	if(tcb->minrtt == 0)
+		return 0;
+	return (tcb->cwind * 1000L) / tcb->minrtt;
+}
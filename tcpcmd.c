@@ -14,16 +14,28 @@
 #include "session.h"
 
 int Tcp_tstamps = 1;
+int Tcp_sack = 1;
+int Tcp_pace = 0;
+int32 Tcp_ackdelay = 0;		/* Delayed ACK timeout, ms; 0 = ack at once */
+int Tcp_ackevery = 2;		/* Ack at least every this many full segments */
+int Tcp_ackstretch = 2;		/* Same, during bulk transfers */
 
+static int doackdelay(int argc,char *argv[],void *p);
+static int doackevery(int argc,char *argv[],void *p);
+static int doackstretch(int argc,char *argv[],void *p);
+static int docc(int argc,char *argv[],void *p);
 static int doirtt(int argc,char *argv[],void *p);
 static int domss(int argc,char *argv[],void *p);
+static int dopace(int argc,char *argv[],void *p);
 static int dortt(int argc,char *argv[],void *p);
 static int dotcpkick(int argc,char *argv[],void *p);
 static int dotcpreset(int argc,char *argv[],void *p);
 static int dotcpstat(int argc,char *argv[],void *p);
 static int dotcptr(int argc,char *argv[],void *p);
 static int dowindow(int argc,char *argv[],void *p);
+static int dosack(int argc,char *argv[],void *p);
 static int dosyndata(int argc,char *argv[],void *p);
+static int dotwmax(int argc,char *argv[],void *p);
 static int dotimestamps(int argc,char *argv[],void *p);
 static int tstat(void);
 static int keychar(int c);
@@ -31,15 +43,22 @@ static void tcprepstat(int interval,void *p1,void *p2);
 
 /* TCP subcommand table */
 static struct cmds Tcpcmds[] = {
+	"ackdelay",	doackdelay,	0, 0,	NULL,
+	"ackevery",	doackevery,	0, 0,	NULL,
+	"ackstretch",	doackstretch,	0, 0,	NULL,
+	"cc",		docc,		0, 0,	NULL,
 	"irtt",		doirtt,		0, 0,	NULL,
 	"kick",		dotcpkick,	0, 2,	"tcp kick <tcb>",
 	"mss",		domss,		0, 0,	NULL,
+	"pace",		dopace,		0, 0,	NULL,
 	"reset",	dotcpreset,	0, 2,	"tcp reset <tcb>",
 	"rtt",		dortt,		0, 3,	"tcp rtt <tcb> <val>",
+	"sack",		dosack,		0, 0,	NULL,
 	"status",	dotcpstat,	0, 0,	"tcp stat <tcb> [<interval>]",
 	"syndata",	dosyndata,	0, 0,	NULL,
 	"timestamps",	dotimestamps,	0, 0,   NULL,
 	"trace",	dotcptr,	0, 0,	NULL,
+	"twmax",	dotwmax,	0, 0,	NULL,
 	"window",	dowindow,	0, 0,	NULL,
 	NULL,
 };
@@ -51,6 +70,67 @@ void *p;
 {
 	return subcmd(Tcpcmds,argc,argv,p);
 }
+/* Show or set the default congestion control, or set it for one TCB:
+ * "tcp cc [<name>]" or "tcp cc <tcb> <name>"
+ */
+static int
+docc(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	register struct tcb *tcb;
+	struct tcp_cc *cc,**ccp;
+
+	if(argc < 2){
+		printf("Default: %s Available:",Tcp_cc->name);
+		for(ccp = Tcp_ccs;*ccp != NULL;ccp++)
+			printf(" %s",(*ccp)->name);
+		printf("\n");
+		return 0;
+	}
+	if((cc = tcp_ccfind(argv[argc-1])) == NULL){
+		printf("Unknown congestion control %s\n",argv[argc-1]);
+		return 1;
+	}
+	if(argc == 2){
+		Tcp_cc = cc;
+		return 0;
+	}
+	tcb = (struct tcb *)ltop(htol(argv[1]));
+	if(!tcpval(tcb)){
+		printf(Notval);
+		return 1;
+	}
+	/* On a server TCB, this is inherited by each connection */
+	tcb->flags.ccset = 1;
+	tcp_ccinit(tcb,cc);
+	return 0;
+}
+static int
+doackdelay(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Tcp_ackdelay,"TCP delayed ACK time (ms)",argc,argv);
+}
+static int
+doackevery(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setint(&Tcp_ackevery,"TCP ACK every n segments",argc,argv);
+}
+static int
+doackstretch(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setint(&Tcp_ackstretch,"TCP bulk ACK every n segments",argc,argv);
+}
 static int
 dotcptr(argc,argv,p)
 int argc;
@@ -60,6 +140,30 @@ void *p;
 	return setbool(&Tcp_trace,"TCP state tracing",argc,argv);
 }
 static int
+dosack(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setbool(&Tcp_sack,"TCP selective acks",argc,argv);
+}
+static int
+dopace(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setbool(&Tcp_pace,"TCP pacing",argc,argv);
+}
+static int
+dotwmax(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	return setlong(&Tcptwmax,"TCP TIME_WAIT record limit",argc,argv);
+}
+static int
 dotimestamps(argc,argv,p)
 int argc;
 char *argv[];
@@ -250,6 +354,19 @@ tstat()
 	}
 	if((j % 2) == 0)
 		printf("\n");
+	printf("SACK blocks out %lu in %lu, hole resends %lu (%lu bytes), recoveries %lu, timeouts %lu\n",
+	 Tcpsackout,Tcpsackin,Tcpsackholes,Tcpsackbytes,Tcpsackrecov,
+	 Tcptimeouts);
+	printf("Pacing %s, segments held back %lu\n",Tcp_pace ? "on" : "off",
+	 Tcppaced);
+	printf("ACKs held %lu, sent on timer %lu, carried by data %lu, stretched %lu\n",
+	 Tcpackheld,Tcpacktimer,Tcpackcarry,Tcpackstretch);
+	printf("TIME_WAIT records %u/%lu, entered %lu, acks %lu, reused %lu, dropped %lu\n",
+	 Ntcptw,Tcptwmax,Tcptws,Tcptwacks,Tcptwreuse,Tcptwdrops);
+	printf("TCBs %u, hash chains %u, lookups %lu, probes %lu (%lu.%02lu/lookup)\n",
+	 Ntcbs,Ntcbhash,Tcblookups,Tcbprobes,
+	 Tcblookups != 0 ? Tcbprobes/Tcblookups : 0,
+	 Tcblookups != 0 ? (Tcbprobes % Tcblookups)*100/Tcblookups : 0);
 
 	printf("&TCB      Rcv-Q Snd-Q  Local socket           Remote socket          State\n");
 	for(tcb=Tcbs;tcb != NULL;tcb = tcb->next){
@@ -269,6 +386,7 @@ st_tcp(tcb)
 struct tcb *tcb;
 {
 	int32 sent,recvd;
+	int i;
 
 	if(tcb == NULL)
 		return;
@@ -341,13 +459,29 @@ struct tcb *tcb;
 	printf(" %10lu%10lu%10lu%10lu%10lu",(long)read_timer(&tcb->timer),
 	 (long)dur_timer(&tcb->timer),tcb->rtt,tcb->srtt,tcb->mdev);
 	printf("   %s\n",tcb->flags.ts_ok ? "timestamps":"standard");
+	printf("Congestion control: %s",tcb->cc->name);
+	if(tcb->minrtt != 0)
+		printf(" min RTT %lu",tcb->minrtt);
+	printf("\n");
+	printf("Pacing: rate %lu bytes/sec, held back %lu, max burst %u\n",
+	 tcb->pacerate,tcb->paced,tcb->maxburst);
+	printf("Delayed ACKs: held %lu, pending %lu bytes%s\n",tcb->ackheld,
+	 tcb->ackpend,tcb->ackbulk >= TCP_BULKSEGS ? " (bulk)" : "");
+
+	if(tcb->flags.sack_ok){
+		printf("SACK: %lu bytes resent from holes",tcb->sackbytes);
+		for(i=0;i<tcb->nsacked;i++)
+			printf(" %08lx-%08lx",tcb->sacked[i].start,tcb->sacked[i].end);
+		printf("\n");
+	}
 
 	if(tcb->reseq != (struct reseq *)NULL){
 		register struct reseq *rp;
 
 		printf("Reassembly queue:\n");
 		for(rp = tcb->reseq;rp != (struct reseq *)NULL; rp = rp->next){
-			printf("  seq x%lx %u bytes\n",rp->seg.seq,rp->length);
+			printf("  seq x%lx %lu bytes%s\n",rp->seq,rp->end - rp->seq,
+			 rp->fin ? " FIN" : "");
 		}
 	}
 }
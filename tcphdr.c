@@ -22,6 +22,7 @@ int32 ipdest
 ){
 	uint16 hdrlen;
 	register uint8 *cp;
+	int i;
 
 	if(bpp == NULL)
 		return;
@@ -32,6 +33,10 @@ int32 ipdest
 		hdrlen += TSTAMP_LENGTH;
 	if(tcph->flags.wscale)
 		hdrlen += WSCALE_LENGTH;
+	if(tcph->flags.sackok)
+		hdrlen += SACKOK_LENGTH;
+	if(tcph->nsack != 0)
+		hdrlen += 2 + SACK_LENGTH(tcph->nsack);	/* Two NOPs first */
 
 	hdrlen = (hdrlen + 3) & 0xfc;	/* Round up to multiple of 4 */
 	pushdown(bpp,NULL,hdrlen);
@@ -79,6 +84,23 @@ int32 ipdest
 		*cp++ = WSCALE_LENGTH;
 		*cp++ = tcph->wsopt;
 	}
+	if(tcph->flags.sackok){
+		*cp++ = SACKOK_KIND;
+		*cp++ = SACKOK_LENGTH;
+	}
+	if(tcph->nsack != 0){
+		/* Pad so the blocks are aligned when there are no other
+		 * options or only timestamps
+		 */
+		*cp++ = NOOP_KIND;
+		*cp++ = NOOP_KIND;
+		*cp++ = SACK_KIND;
+		*cp++ = SACK_LENGTH(tcph->nsack);
+		for(i=0;i<tcph->nsack;i++){
+			cp = put32(cp,tcph->sack[i].start);
+			cp = put32(cp,tcph->sack[i].end);
+		}
+	}
 	if(tcph->checksum == 0){
 		/* Recompute header checksum */
 		struct pseudo_header ph;
@@ -96,7 +118,7 @@ ntohtcp(
 struct tcp *tcph,
 struct mbuf **bpp
 ){
-	int hdrlen,i,optlen,kind;
+	int hdrlen,i,j,optlen,kind;
 	register int flags;
 	uint8 hdrbuf[TCPLEN],*cp;
 	uint8 options[TCP_MAXOPT];
@@ -171,6 +193,20 @@ struct mbuf **bpp
 				tcph->flags.tstamp = 1;
 			}
 			break;
+		case SACKOK_KIND:
+			if(optlen == SACKOK_LENGTH)
+				tcph->flags.sackok = 1;
+			break;
+		case SACK_KIND:
+			if(optlen >= SACK_LENGTH(1) && optlen <= SACK_LENGTH(MAXSACK)
+			 && (optlen - 2) % 8 == 0 && optlen - 2 < i){
+				tcph->nsack = (optlen - 2) / 8;
+				for(j=0;j<tcph->nsack;j++){
+					tcph->sack[j].start = get32(cp + 8*j);
+					tcph->sack[j].end = get32(cp + 8*j + 4);
+				}
+			}
+			break;
 		}
 		optlen = max(2,optlen);	/* Enforce legal minimum */
 		i -= optlen;
@@ -15,13 +15,20 @@
 
 static void update(struct tcb *tcb,struct tcp *seg,uint16 length);
 static void proc_syn(struct tcb *tcb,uint8 tos,struct tcp *seg);
-static void add_reseq(struct tcb *tcb,uint8 tos,struct tcp *seg,
+static void add_reseq(struct tcb *tcb,struct tcp *seg,
 	struct mbuf **bp,uint16 length);
-static void get_reseq(struct tcb *tcb,uint8 *tos,struct tcp *seq,
+static int get_reseq(struct tcb *tcb,struct tcp *seg,
 	struct mbuf **bp,uint16 *length);
+static void reseq_append(struct reseq *rp,struct mbuf **bpp);
 static int trim(struct tcb *tcb,struct tcp *seg,struct mbuf **bpp,
 	uint16 *length);
 static int in_window(struct tcb *tcb,int32 seq);
+static void sack_update(struct tcb *tcb,struct tcp *seg);
+static void sack_prune(struct tcb *tcb);
+static int32 sack_hole(struct tcb *tcb,int32 *seqp);
+static int32 sack_rexmit(struct tcb *tcb);
+static int32 resend(struct tcb *tcb,int32 seq,int32 len);
+static void ack_data(struct tcb *tcb,uint16 length);
 
 /* This function is called from IP with the IP header in machine byte order,
  * along with a mbuf chain pointing to the TCP header.
@@ -79,7 +86,11 @@ int32 said		/* Authenticated packet */
 	conn.remote.address = ip->source;
 	conn.remote.port = seg.source;
 	
-	if((tcb = lookup_tcb(&conn)) == NULL){
+	tcb = lookup_tcb(&conn);
+	if((tcb == NULL || tcb->state == TCP_CLOSED)
+	 && tcp_twinput(&seg,&conn,bpp,length) == 0)
+		return;	/* Answered from a TIME_WAIT record */
+	if(tcb == NULL){
 		/* If this segment doesn't carry a SYN, reject it */
 		if(!seg.flags.syn){
 			free_p(bpp);
@@ -106,15 +117,15 @@ int32 said		/* Authenticated packet */
 			ntcb = (struct tcb *)mallocw(sizeof (struct tcb));
 			ASSIGN(*ntcb,*tcb);
 			tcb = ntcb;
-			tcb->timer.arg = tcb;
-			/* Put on list */
-			tcb->next = Tcbs;
-			Tcbs = tcb;
-		}
+			tcb_timers(tcb);
+		} else
+			unlink_tcb(tcb);	/* Connection is changing */
 		/* Put all the socket info into the TCB */
 		tcb->conn.local.address = ip->dest;
 		tcb->conn.remote.address = ip->source;
 		tcb->conn.remote.port = seg.source;
+		/* Put on list under its new connection */
+		link_tcb(tcb);
 	}
 	tcb->flags.congest = ip->flags.congest;
 	/* Do unsynchronized-state processing (p. 65-68) */
@@ -220,7 +231,7 @@ int32 said		/* Authenticated packet */
 	 */
 	if(seg.seq != tcb->rcv.nxt
 	 && (length != 0 || seg.flags.syn || seg.flags.fin)){
-		add_reseq(tcb,ip->tos,&seg,bpp,length);
+		add_reseq(tcb,&seg,bpp,length);
 		if(seg.flags.ack && !seg.flags.rst)
 			tcb->flags.force = 1;
 		seg.flags.syn = seg.flags.fin = 0;
@@ -302,6 +313,7 @@ int32 said		/* Authenticated packet */
 				/* Our FIN is acknowledged */
 				settcpstate(tcb,TCP_TIME_WAIT);
 				set_timer(&tcb->timer,MSL2*1000L);
+				set_timer_slack(&tcb->timer,1000L);
 				start_timer(&tcb->timer);
 			}
 			break;
@@ -321,7 +333,7 @@ int32 said		/* Authenticated packet */
 		/* (URGent bit processing skipped here) */
 
 		/* Process the segment text, if any, beginning at rcv.nxt (p. 74) */
-		if(length != 0){
+text:		if(length != 0){
 			switch(tcb->state){
 			case TCP_SYN_RECEIVED:
 			case TCP_ESTABLISHED:
@@ -337,7 +349,7 @@ int32 said		/* Authenticated packet */
 				tcb->rcvcnt += length;
 				tcb->rcv.nxt += length;
 				tcb->rcv.wnd -= length;
-				tcb->flags.force = 1;
+				ack_data(tcb,length);
 				/* Notify user */
 				if(tcb->r_upcall)
 					(*tcb->r_upcall)(tcb,tcb->rcvcnt);
@@ -364,6 +376,7 @@ int32 said		/* Authenticated packet */
 					/* Our FIN has been acked; bypass TCP_CLOSING state */
 					settcpstate(tcb,TCP_TIME_WAIT);
 					set_timer(&tcb->timer,MSL2*1000L);
+					set_timer_slack(&tcb->timer,1000L);
 					start_timer(&tcb->timer);
 				} else {
 					settcpstate(tcb,TCP_CLOSING);
@@ -373,6 +386,7 @@ int32 said		/* Authenticated packet */
 				tcb->rcv.nxt++;
 				settcpstate(tcb,TCP_TIME_WAIT);
 				set_timer(&tcb->timer,MSL2*1000L);
+				set_timer_slack(&tcb->timer,1000L);
 				start_timer(&tcb->timer);
 				break;
 			case TCP_CLOSE_WAIT:
@@ -387,19 +401,19 @@ int32 said		/* Authenticated packet */
 			if(tcb->r_upcall)
 				(*tcb->r_upcall)(tcb,tcb->rcvcnt);
 		}
-		/* Scan the resequencing queue, looking for a segment we can handle,
-		 * and freeing all those that are now obsolete.
+		/* If the first out-of-order range is now in sequence, deliver
+		 * it as the text of a new segment; its ACK was processed when
+		 * it arrived. Ranges that turn out to be entirely old are freed.
 		 */
-		while(tcb->reseq != NULL && seq_ge(tcb->rcv.nxt,tcb->reseq->seg.seq)){
-			get_reseq(tcb,&ip->tos,&seg,bpp,&length);
-			if(trim(tcb,&seg,bpp,&length) == 0)
-				goto gotone;
-			/* Segment is an old one; trim has freed it */
+		while(tcb->reseq != NULL && seq_ge(tcb->rcv.nxt,tcb->reseq->seq)){
+			if(get_reseq(tcb,&seg,bpp,&length) == 0)
+				goto text;
 		}
 		break;
-gotone:	;
 	}
 	tcp_output(tcb);	/* Send any necessary ack */
+	if(tcb->state == TCP_TIME_WAIT)
+		tcp_timewait(tcb);	/* Trade the TCB for a compact record */
 }
 
 /* Process an incoming ICMP response */
@@ -446,13 +460,10 @@ struct mbuf **bpp		/* First 8 bytes of TCP header */
 		tcb->unreach++;
 		break;
 	case ICMP_QUENCH:
-		/* Source quench; reduce slowstart threshold to half
-		 * current window and restart slowstart
+		/* Source quench; cut the congestion window as though
+		 * we'd had a timeout
 		 */
-		tcb->ssthresh = tcb->cwind / 2;
-		tcb->ssthresh = max(tcb->ssthresh,tcb->mss);
-		/* Shrink congestion window to 1 packet */
-		tcb->cwind = tcb->mss;
+		(*tcb->cc->rto)(tcb);
 		tcb->quench++;
 		break;
 	}
@@ -503,12 +514,15 @@ register struct tcp *seg;	/* Offending TCP header */
 	seg->flags.mss = 0;
 	seg->flags.wscale = 0;
 	seg->flags.tstamp = 0;
+	seg->flags.sackok = 0;
+	seg->nsack = 0;
 	seg->wnd = 0;
 	seg->up = 0;
 	seg->checksum = 0;	/* force recomputation */
 
-	hbp = ambufw(TCP_HDR_PAD);	/* Prealloc room for headers */
-	hbp->data += TCP_HDR_PAD;
+	/* Prealloc room for headers */
+	hbp = NULL;
+	hdrroom(&hbp,TCPLEN + ip_hdrroom(ip->source));
 	htontcp(seg,&hbp,ip->dest,ip->source);
 	/* Ship it out (note swap of addresses) */
 	ip_send(ip->dest,ip->source,TCP_PTCL,ip->tos,0,&hbp,len_p(hbp),0,0);
@@ -529,12 +543,16 @@ uint16 length;
 	int32 swind;	/* Incoming window, scaled (non-SYN only) */
 	long rtt;	/* measured round trip time */
 	int32 abserr;	/* abs(rtt - srtt) */
+	int partial = 0;	/* Partial ack during fast recovery */
+	int32 oldcwind;
 
 	acked = 0;
 	if(seq_gt(seg->ack,tcb->snd.nxt)){
 		tcb->flags.force = 1;	/* Acks something not yet sent */
 		return;
 	}
+	if(tcb->flags.sack_ok && seg->nsack != 0)
+		sack_update(tcb,seg);
 	/* Decide if we need to do a window update.
 	 * This is always checked whenever a legal ACK is received,
 	 * even if it doesn't actually acknowledge anything,
@@ -582,23 +600,21 @@ uint16 length;
 			 * Resend it now to avoid a timeout. (This is
 			 * Van Jacobson's 'quick recovery' algorithm.)
 			 */
-			int32 ptrsave;
-
-			/* Knock the threshold down just as though
-			 * this were a timeout, since we've had
+			/* Knock the threshold down as the congestion
+			 * control module sees fit, since we've had
 			 * network congestion.
 			 */
-			tcb->ssthresh = tcb->cwind/2;
-			tcb->ssthresh = max(tcb->ssthresh,tcb->mss);
+			(*tcb->cc->loss)(tcb);
+			tcb->recover = tcb->snd.nxt;
 
-			/* Manipulate the machinery in tcp_output() to
-			 * retransmit just the missing packet
-			 */
-			ptrsave = tcb->snd.ptr;
-			tcb->snd.ptr = tcb->snd.una;
-			tcb->cwind = tcb->mss;
-			tcp_output(tcb);
-			tcb->snd.ptr = ptrsave;
+			if(tcb->flags.sack_ok && tcb->nsacked != 0){
+				/* The first hole starts at snd.una */
+				tcb->rexmt = tcb->snd.una;
+				sack_rexmit(tcb);
+			} else {
+				/* Retransmit just the missing packet */
+				resend(tcb,tcb->snd.una,tcb->mss);
+			}
 
 			/* "Inflate" the congestion window, pretending as
 			 * though the duplicate acks were normally acking
@@ -607,9 +623,13 @@ uint16 length;
 			tcb->cwind = tcb->ssthresh + TCPDUPACKS*tcb->mss;
 		} else if(tcb->dupacks > TCPDUPACKS){
 			/* Continue to inflate the congestion window
-			 * until the acks finally get "unstuck".
+			 * until the acks finally get "unstuck". With
+			 * SACK, each further duplicate also lets us
+			 * fill one more hole.
 			 */
 			tcb->cwind += tcb->mss;
+			if(tcb->flags.sack_ok)
+				sack_rexmit(tcb);
 		}
 		/* Clamp the congestion window at the amount currently
 		 * on the send queue, with a minimum of one packet.
@@ -622,6 +642,15 @@ uint16 length;
 		return;
 	}
 	/* We're here, so the ACK must have actually acked something */
+	if(tcb->dupacks >= TCPDUPACKS){
+		/* An ack short of the recovery point means more was lost
+		 * (NewReno); stay in recovery and resend it below.
+		 */
+		if(seq_lt(seg->ack,tcb->recover))
+			partial = 1;
+		else if(tcb->flags.sack_ok)
+			Tcpsackrecov++;
+	}
 	if(tcb->dupacks >= TCPDUPACKS && tcb->cwind > tcb->ssthresh){
 		/* The acks have finally gotten "unstuck". So now we
 		 * can "deflate" the congestion window, i.e. take it
@@ -630,27 +659,9 @@ uint16 length;
 		 */
 		tcb->cwind = tcb->ssthresh;
 	}
-	tcb->dupacks = 0;
+	tcb->dupacks = partial ? TCPDUPACKS : 0;
 	acked = seg->ack - tcb->snd.una;
 
-	/* Expand congestion window if not already at limit and if
-	 * this packet wasn't retransmitted
-	 */
-	if(tcb->cwind < tcb->snd.wnd && !tcb->flags.retran){
-		if(tcb->cwind < tcb->ssthresh){
-			/* Still doing slow start/CUTE, expand by amount acked */
-			tcb->cwind += min(acked,tcb->mss);
-		} else {
-			/* Steady-state test of extra path capacity */
-			tcb->cwind += ((long)tcb->mss * tcb->mss) / tcb->cwind;
-		}
-		/* Don't expand beyond the offered window */
-		if(tcb->cwind > tcb->snd.wnd)
-			tcb->cwind = tcb->snd.wnd;
-	}
-	tcb->cwind = min(tcb->cwind,tcb->sndcnt);	/* Clamp */
-	tcb->cwind = max(tcb->cwind,tcb->mss);
-
 	/* Round trip time estimation */
 	rtt = -1;	/* Init to invalid value */
 	if(tcb->flags.ts_ok && seg->flags.tstamp){
@@ -683,6 +694,18 @@ uint16 length;
 		if(rtt != 0)	/* Avoid division by zero */
 			tcb->txbw = 1000*(seg->ack - tcb->rttack)/rtt;
 	}
+	/* Let the congestion control module adjust the window,
+	 * unless this packet was retransmitted
+	 */
+	if(!tcb->flags.retran){
+		oldcwind = tcb->cwind;
+		(*tcb->cc->ack)(tcb,acked,rtt);
+		/* Don't expand beyond the offered window */
+		if(tcb->cwind > oldcwind && tcb->cwind > tcb->snd.wnd)
+			tcb->cwind = max(oldcwind,tcb->snd.wnd);
+	}
+	tcb->cwind = min(tcb->cwind,tcb->sndcnt);	/* Clamp */
+	tcb->cwind = max(tcb->cwind,tcb->mss);
 	tcb->sndcnt -= acked;	/* Update virtual byte count on snd queue */
 	tcb->snd.una = seg->ack;
 
@@ -710,6 +733,14 @@ uint16 length;
 	 */
 	if(seq_lt(tcb->snd.ptr,tcb->snd.una))
 		tcb->snd.ptr = tcb->snd.una;
+	if(tcb->nsacked != 0)
+		sack_prune(tcb);
+	if(partial){
+		if(tcb->flags.sack_ok && tcb->nsacked != 0)
+			sack_rexmit(tcb);
+		else
+			resend(tcb,tcb->snd.una,tcb->mss);
+	}
 
 	/* Clear the retransmission flag since the oldest
 	 * unacknowledged segment (the only one that is ever retransmitted)
@@ -747,6 +778,8 @@ struct tcp *seg;
 {
 	uint16 mtu;
 	struct tcp_rtt *tp;
+	struct tcp_cc *cc;
+	struct route *rp;
 
 	tcb->flags.force = 1;	/* Always send a response */
 
@@ -772,6 +805,8 @@ struct tcp *seg;
 		tcb->flags.ts_ok = 1;
 		tcb->ts_recent = seg->tsval;
 	}
+	if(seg->flags.sackok && Tcp_sack)
+		tcb->flags.sack_ok = 1;
 	/* Check the MTU of the interface we'll use to reach this guy
 	 * and lower the MSS so that unnecessary fragmentation won't occur
 	 */
@@ -788,6 +823,17 @@ struct tcp *seg;
 		tcb->srtt = tp->srtt;
 		tcb->mdev = tp->mdev;
 	}
+	/* Unless the user picked one, use the congestion control
+	 * configured for the route to this guy, or the default
+	 */
+	cc = tcb->cc;
+	if(!tcb->flags.ccset){
+		cc = Tcp_cc;
+		if((rp = rt_lookup(tcb->conn.remote.address)) != NULL
+		 && rp->tcpcc != NULL)
+			cc = rp->tcpcc;
+	}
+	tcp_ccinit(tcb,cc);
 }
 
 /* Generate an initial sequence number and put a SYN on the send queue */
@@ -802,72 +848,172 @@ register struct tcb *tcb;
 	tcb->flags.force = 1;
 }
 
-/* Add an entry to the resequencing queue in the proper place */
+/* Add a segment's data to the resequencing queue. Whatever overlaps
+ * data already held is trimmed off (and counted as duplicate) here, once,
+ * and the segment is merged with any range it abuts, so the queue stays
+ * a short list of disjoint ranges however the data arrives.
+ */
 static void
 add_reseq(
 struct tcb *tcb,
-uint8 tos,
 struct tcp *seg,
 struct mbuf **bpp,
 uint16 length
 ){
-	register struct reseq *rp,*rp1;
+	register struct reseq *rp;
+	struct reseq *prev,*np,*rp1;
+	int32 seq,end,dup;
+	char fin;
 
-	/* Allocate reassembly descriptor */
-	if((rp = (struct reseq *)malloc(sizeof (struct reseq))) == NULL){
-		/* No space, toss on floor */
+	if(seg->flags.syn){
+		/* Not valid once synchronized; don't keep it */
 		free_p(bpp);
 		return;
 	}
-	ASSIGN(rp->seg,*seg);
-	rp->tos = tos;
-	rp->bp = (*bpp);
-	*bpp = NULL;
-	rp->length = length;
+	seq = seg->seq;
+	fin = seg->flags.fin;
+	tcb->sackin = seq;	/* Reported first in SACK blocks */
 
-	/* Place on reassembly list sorting by starting seq number */
-	rp1 = tcb->reseq;
-	if(rp1 == NULL || seq_lt(seg->seq,rp1->seg.seq)){
-		/* Either the list is empty, or we're less than all other
-		 * entries; insert at beginning.
-		 */
-		rp->next = rp1;
-		tcb->reseq = rp;
+	/* Find the last range starting at or before us */
+	prev = NULL;
+	for(rp = tcb->reseq;rp != NULL && seq_le(rp->seq,seq);rp = rp->next)
+		prev = rp;
+
+	if(prev != NULL && seq_gt(prev->end,seq)){
+		/* Trim off what the earlier range already holds */
+		dup = min(prev->end - seq,(int32)length);
+		tcb->rerecv += dup;
+		pullup(bpp,NULL,(uint16)dup);
+		seq += dup;
+		length -= dup;
+	}
+	if(length == 0 && prev != NULL && seq_le(seq,prev->end)){
+		/* Nothing new, except perhaps a FIN */
+		if(fin && seq == prev->end && !prev->fin)
+			prev->fin = 1;
+		else
+			tcb->rerecv += fin;
+		free_p(bpp);
+		return;
+	}
+	end = seq + length;
+	if(prev != NULL && prev->end == seq && !prev->fin
+	 && prev->end - prev->seq + length <= RESEQMAX){
+		np = prev;	/* We'll extend the earlier range */
+	} else if((np = (struct reseq *)malloc(sizeof(struct reseq))) == NULL){
+		/* No space, toss on floor */
+		free_p(bpp);
+		return;
 	} else {
-		/* Find the last entry less than us */
-		for(;;){
-			if(rp1->next == NULL || seq_lt(seg->seq,rp1->next->seg.seq)){
-				/* We belong just after this one */
-				rp->next = rp1->next;
-				rp1->next = rp;
-				break;
-			}
-			rp1 = rp1->next;
+		np->seq = seq;
+		np->bp = np->tail = NULL;
+		np->fin = 0;
+		if(prev != NULL)
+			prev->next = np;
+		else
+			tcb->reseq = np;
+	}
+	/* Discard later ranges we cover, and trim the front off one we
+	 * partly overlap
+	 */
+	while(rp != NULL && seq_lt(rp->seq,end)){
+		if(seq_gt(rp->end,end)){
+			dup = end - rp->seq;
+			tcb->rerecv += dup;
+			pullup(&rp->bp,NULL,(uint16)dup);
+			rp->seq = end;
+			break;
+		}
+		tcb->rerecv += rp->end - rp->seq;
+		if(rp->fin){
+			if(rp->end == end && !fin)
+				fin = 1;
+			else
+				tcb->rerecv++;
 		}
+		rp1 = rp->next;
+		free_p(&rp->bp);
+		free(rp);
+		rp = rp1;
 	}
-}
+	reseq_append(np,bpp);
+	np->end = end;
+	np->fin = fin;
+	np->next = rp;
 
-/* Fetch the first entry off the resequencing queue */
-static void
+	/* Absorb the next range if we now abut it (or it's just our FIN) */
+	if(rp != NULL && rp->seq == end && (!fin || rp->end == end)
+	 && rp->end - np->seq <= RESEQMAX){
+		tcb->rerecv += fin;
+		if(rp->bp != NULL){
+			if(np->tail == NULL)
+				np->bp = rp->bp;
+			else
+				np->tail->next = rp->bp;
+			np->tail = rp->tail;
+		}
+		np->end = rp->end;
+		np->fin = rp->fin;
+		np->next = rp->next;
+		free(rp);
+	}
+}
+/* Take the first range off the resequencing queue as a segment starting
+ * at rcv.nxt, trimming off anything received since it was queued.
+ * Return -1 if nothing new is left of it.
+ */
+static int
 get_reseq(
 register struct tcb *tcb,
-uint8 *tos,
 struct tcp *seg,
-struct mbuf **bp,
+struct mbuf **bpp,
 uint16 *length
 ){
 	register struct reseq *rp;
+	int32 dup;
 
 	if((rp = tcb->reseq) == NULL)
-		return;
-
+		return -1;
 	tcb->reseq = rp->next;
 
-	*tos = rp->tos;
-	ASSIGN(*seg,rp->seg);
-	*bp = rp->bp;
-	*length = rp->length;
+	dup = tcb->rcv.nxt - rp->seq;
+	if(seq_ge(tcb->rcv.nxt,rp->end + rp->fin)){
+		/* Entirely old */
+		tcb->rerecv += rp->end - rp->seq + rp->fin;
+		free_p(&rp->bp);
+		free(rp);
+		return -1;
+	}
+	if(dup > 0){
+		tcb->rerecv += dup;
+		pullup(&rp->bp,NULL,(uint16)dup);
+	}
+	seg->seq = tcb->rcv.nxt;
+	seg->flags.syn = 0;
+	seg->flags.fin = rp->fin;
+	*length = (uint16)(rp->end - tcb->rcv.nxt);
+	*bpp = rp->bp;
 	free(rp);
+	return 0;
+}
+/* Link data onto the end of a range without walking its chain */
+static void
+reseq_append(
+struct reseq *rp,
+struct mbuf **bpp
+){
+	register struct mbuf *bp;
+
+	if((bp = *bpp) == NULL)
+		return;
+	*bpp = NULL;
+	if(rp->tail == NULL)
+		rp->bp = bp;
+	else
+		rp->tail->next = bp;
+	while(bp->next != NULL)
+		bp = bp->next;
+	rp->tail = bp;
 }
 
 /* Trim segment to fit window. Return 0 if OK, -1 if segment is
@@ -940,3 +1086,189 @@ uint16 *length
 	}
 	return 0;
 }
+/* Merge the SACK blocks in an incoming ack into the scoreboard. Blocks
+ * at or below snd.una (D-SACKs) or beyond snd.nxt are ignored. If the
+ * scoreboard fills, the highest range is forgotten; that only costs
+ * an unnecessary retransmission.
+ */
+static void
+sack_update(
+struct tcb *tcb,
+struct tcp *seg
+){
+	register struct sackblk *sb = tcb->sacked;
+	int32 start,end;
+	int i,j,k,n;
+
+	for(k=0;k<seg->nsack;k++){
+		start = seg->sack[k].start;
+		end = seg->sack[k].end;
+		if(!seq_lt(start,end) || !seq_gt(end,tcb->snd.una)
+		 || seq_gt(end,tcb->snd.nxt))
+			continue;
+		if(seq_lt(start,tcb->snd.una))
+			start = tcb->snd.una;
+		Tcpsackin++;
+		n = tcb->nsacked;
+
+		/* Find the first range that doesn't end before us, then
+		 * absorb every range that overlaps or abuts us
+		 */
+		for(i=0;i<n && seq_lt(sb[i].end,start);i++)
+			;
+		for(j=i;j<n && seq_le(sb[j].start,end);j++){
+			if(seq_lt(sb[j].start,start))
+				start = sb[j].start;
+			if(seq_gt(sb[j].end,end))
+				end = sb[j].end;
+		}
+		if(j == i){
+			/* Nothing absorbed; open a slot */
+			if(n == TCPSACKSB){
+				if(i == n)
+					continue;	/* We'd be the one dropped */
+				n--;
+			}
+			memmove(&sb[i+1],&sb[i],(n-i)*sizeof(struct sackblk));
+			n++;
+		} else if(j > i+1){
+			/* Close up the ranges we absorbed */
+			memmove(&sb[i+1],&sb[j],(n-j)*sizeof(struct sackblk));
+			n -= j-i-1;
+		}
+		sb[i].start = start;
+		sb[i].end = end;
+		tcb->nsacked = n;
+	}
+}
+/* Drop scoreboard ranges that snd.una has passed */
+static void
+sack_prune(
+struct tcb *tcb
+){
+	register struct sackblk *sb = tcb->sacked;
+	int i;
+
+	for(i=0;i<tcb->nsacked && !seq_gt(sb[i].end,tcb->snd.una);i++)
+		;
+	if(i != 0){
+		tcb->nsacked -= i;
+		memmove(&sb[0],&sb[i],tcb->nsacked*sizeof(struct sackblk));
+	}
+	if(tcb->nsacked != 0 && seq_lt(sb[0].start,tcb->snd.una))
+		sb[0].start = tcb->snd.una;
+}
+/* Find the first hole in the scoreboard at or after *seqp, below the
+ * highest selectively acked sequence number. Set *seqp to its start
+ * and return its length, or return 0 if there isn't one.
+ */
+static int32
+sack_hole(
+struct tcb *tcb,
+int32 *seqp
+){
+	register struct sackblk *sb = tcb->sacked;
+	int32 seq;
+	int i;
+
+	seq = *seqp;
+	if(seq_lt(seq,tcb->snd.una))
+		seq = tcb->snd.una;
+	for(i=0;i<tcb->nsacked;i++){
+		if(seq_lt(seq,sb[i].start)){
+			*seqp = seq;
+			return sb[i].start - seq;
+		}
+		if(seq_lt(seq,sb[i].end))
+			seq = sb[i].end;
+	}
+	return 0;
+}
+/* Resend up to one segment from the next hole in the scoreboard.
+ * Return the number of bytes resent.
+ */
+static int32
+sack_rexmit(
+struct tcb *tcb
+){
+	int32 seq,len;
+
+	seq = tcb->rexmt;
+	if((len = sack_hole(tcb,&seq)) == 0)
+		return 0;
+	if((len = resend(tcb,seq,min(len,tcb->mss))) == 0)
+		return 0;	/* Window must have shrunk */
+
+	tcb->rexmt = seq + len;
+	tcb->sackbytes += len;
+	Tcpsackholes++;
+	Tcpsackbytes += len;
+	return len;
+}
+/* Resend up to len bytes starting at seq by manipulating the snd.ptr
+ * and cwind machinery in tcp_output(). Return the number of bytes sent.
+ */
+static int32
+resend(
+struct tcb *tcb,
+int32 seq,
+int32 len
+){
+	int32 ptrsave,cwsave;
+	int force;
+
+	ptrsave = tcb->snd.ptr;
+	cwsave = tcb->cwind;
+	force = tcb->flags.force;
+	tcb->snd.ptr = seq;
+	tcb->cwind = seq - tcb->snd.una + len;
+	tcb->flags.force = 0;	/* Would suppress the data */
+	tcp_output(tcb);
+	len = tcb->snd.ptr - seq;
+	tcb->snd.ptr = ptrsave;
+	tcb->cwind = cwsave;
+	tcb->flags.force = force;
+	return len;
+}
+/* Decide whether in-sequence data just received must be acked at once.
+ * With delayed acks on, the ACK is held until Tcp_ackevery full-sized
+ * segments have arrived, something else is sent to carry it, or the
+ * delayed ACK timer runs out. That saves a transmitter turnaround per
+ * segment on half duplex channels. A receiver that has been getting
+ * nothing but full-sized segments is taken to be a bulk transfer and
+ * acks only every Tcp_ackstretch segments, but never sits on more than
+ * a quarter of the window. Data that fills a hole is acked at once.
+ */
+static void
+ack_data(
+struct tcb *tcb,
+uint16 length
+){
+	int32 every;
+
+	if(length >= tcb->mss){
+		if(tcb->ackbulk < TCP_BULKSEGS)
+			tcb->ackbulk++;
+	} else
+		tcb->ackbulk = 0;
+	tcb->ackpend += length;
+	if(Tcp_ackdelay == 0 || tcb->reseq != NULL){
+		tcb->flags.force = 1;
+		return;
+	}
+	every = Tcp_ackevery;
+	if(tcb->ackbulk >= TCP_BULKSEGS && Tcp_ackstretch > every)
+		every = Tcp_ackstretch;
+	if(tcb->ackpend >= every * tcb->mss || tcb->ackpend >= tcb->window / 4){
+		if(tcb->ackpend > Tcp_ackevery * tcb->mss)
+			Tcpackstretch++;
+		tcb->flags.force = 1;
+		return;
+	}
+	tcb->ackheld++;
+	Tcpackheld++;
+	if(!run_timer(&tcb->acker)){
+		set_timer(&tcb->acker,Tcp_ackdelay);
+		start_timer(&tcb->acker);
+	}
+}
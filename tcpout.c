@@ -9,6 +9,10 @@
 #include "tcp.h"
 #include "ip.h"
 
+static void sack_blocks(struct tcb *tcb,struct tcp *seg,uint16 ssize);
+static int pace_wait(struct tcb *tcb);
+static void pace_sent(struct tcb *tcb,uint16 ssize);
+
 /* Send a segment on the specified connection. One gets sent only
  * if there is data to be sent or if "force" is non zero
  */
@@ -25,6 +29,8 @@ register struct tcb *tcb;
 	int32 sent;		/* Sequence count (incl SYN/FIN) already
 				 * in the pipe but not yet acked */
 	int32 rto;		/* Retransmit timeout setting */
+	uint16 hroom;		/* Space to leave for headers */
+	int burst = 0;		/* Data segments sent by this call */
 
 	if(tcb == NULL)
 		return;
@@ -34,6 +40,7 @@ register struct tcb *tcb;
 	case TCP_CLOSED:
 		return;	/* Don't send anything */
 	}
+	hroom = TCPLEN + TCP_MAXOPT + ip_hdrroom(tcb->conn.remote.address);
 	for(;;){
 		memset(&seg,0,sizeof(seg));
 		/* Compute data already in flight */
@@ -64,9 +71,10 @@ register struct tcb *tcb;
 		 * If data is already in the pipeline, don't send
 		 * more unless it is MSS-sized, the very last packet,
 		 * or we're being forced to transmit anyway (e.g., to
-		 * ack incoming data).
+		 * ack incoming data). Old data being resent is exempt.
 		 */
 		if(!tcb->flags.force && sent != 0 && ssize < tcb->mss
+		 && !seq_lt(tcb->snd.ptr,tcb->snd.nxt)
 		 && !(tcb->state == TCP_FINWAIT1 && ssize == tcb->sndcnt-sent)){
 			ssize = 0;
 		}
@@ -89,6 +97,8 @@ register struct tcb *tcb;
 			ssize = 0;
 		if(ssize == 0 && !tcb->flags.force)
 			break;		/* No need to send anything */
+		if(ssize != 0 && !tcb->flags.force && pace_wait(tcb))
+			break;		/* Too soon; the pacer will call back */
 
 		tcb->flags.force = 0;	/* Only one forced segment! */
 
@@ -121,6 +131,10 @@ register struct tcb *tcb;
 				seg.flags.tstamp = 1;
 				seg.tsval = msclock();
 			}
+			/* Offer SACK actively, or accept the peer's offer */
+			if(Tcp_sack && (tcb->state == TCP_SYN_SENT
+			 || tcb->flags.sack_ok))
+				seg.flags.sackok = 1;
 		}
 		/* If there's no data, use snd.nxt rather than snd.ptr to
 		 * ensure ack acceptance in case we were retransmitting
@@ -139,11 +153,16 @@ register struct tcb *tcb;
 		 * SYN and FIN occupy sequence space and are reflected in
 		 * sndcnt but don't actually sit in the send queue, extract
 		 * will return one less than dsize if a FIN needs to be sent.
+		 *
+		 * The data isn't copied; dup_p() links references to the
+		 * send queue's own buffers behind an empty mbuf that has
+		 * room for the headers.
 		 */
-		dbp = ambufw(TCP_HDR_PAD+dsize);
-		dbp->data += TCP_HDR_PAD;	/* Allow room for other hdrs */
+		dbp = ambufw(hroom);
+		dbp->data += hroom;	/* Allow room for all the headers */
 		if(dsize != 0){
 			int32 offset;
+			uint16 avail;
 
 			/* SYN doesn't actually take up space on the sndq,
 			 * so take it out of the sent count
@@ -152,8 +171,15 @@ register struct tcb *tcb;
 			if(!tcb->flags.synack && sent != 0)
 				offset--;
 
-			dbp->cnt = extract(tcb->sndq,(uint16)offset,dbp->data,dsize);
-			if(dbp->cnt != dsize){
+			avail = min(len_p(tcb->sndq) - (uint16)offset,dsize);
+			if(dup_p(&dbp->next,tcb->sndq,(uint16)offset,avail) != avail){
+				/* Out of mbuf headers; fall back to copying */
+				free_p(&dbp->next);
+				dbp->next = ambufw(avail);
+				dbp->next->cnt = extract(tcb->sndq,(uint16)offset,
+				 dbp->next->data,avail);
+			}
+			if(avail != dsize){
 				/* We ran past the end of the send queue;
 				 * send a FIN
 				 */
@@ -187,6 +213,9 @@ register struct tcb *tcb;
 			seg.tsval = msclock();
 			seg.tsecr = tcb->ts_recent;
 		}
+		if(tcb->flags.sack_ok && seg.flags.ack && !seg.flags.syn
+		 && tcb->reseq != NULL)
+			sack_blocks(tcb,&seg,ssize);
 		/* Generate TCP header, compute checksum, and link in data */
 		htontcp(&seg,&dbp,tcb->conn.local.address,
 		 tcb->conn.remote.address);
@@ -216,5 +245,135 @@ register struct tcb *tcb;
 
 		ip_send(tcb->conn.local.address,tcb->conn.remote.address,
 		 TCP_PTCL,tcb->tos,0,&dbp,len_p(dbp),0,0);
+		if(tcb->ackpend != 0){
+			/* This segment carries any ACK we were holding */
+			if(ssize != 0 && run_timer(&tcb->acker))
+				Tcpackcarry++;
+			stop_timer(&tcb->acker);
+			tcb->ackpend = 0;
+		}
+		if(ssize != 0){
+			pace_sent(tcb,ssize);
+			burst++;
+		}
+	}
+	if(burst > tcb->maxburst)
+		tcb->maxburst = burst;
+}
+/* Pacing timer expiration: send whatever is now due */
+void
+tcp_pacer(
+void *p
+){
+	tcp_output((struct tcb *)p);
+}
+/* When pacing is on, decide whether the next segment of new data must
+ * wait, and if so make sure the pacer will be along to send it. Without
+ * pacing, a whole window goes out in one burst on each ack, which easily
+ * overruns the output queue limit of a slow serial or KISS port.
+ * Retransmissions aren't held back.
+ */
+static int
+pace_wait(
+struct tcb *tcb
+){
+	int32 wait;
+
+	if(!Tcp_pace || !tcb->flags.synack || tcb->pacerate == 0
+	 || seq_lt(tcb->snd.ptr,tcb->snd.nxt))
+		return 0;
+	if((wait = tcb->pacenext - msclock()) <= 0)
+		return 0;
+	if(!run_timer(&tcb->pacer)){
+		set_timer(&tcb->pacer,wait);
+		start_timer(&tcb->pacer);
+	}
+	tcb->paced++;
+	Tcppaced++;
+	return 1;
+}
+/* Advance the pacing schedule past a segment just sent. The rate comes
+ * from the congestion control module if it has an opinion, otherwise
+ * it's the window delivered once per smoothed round trip; it's scaled
+ * up a little (twice in slow start) so pacing spreads the window out
+ * without holding it back. Credit for idle time is limited to one
+ * clock tick, which is all the timer can resolve anyway.
+ */
+static void
+pace_sent(
+struct tcb *tcb,
+uint16 ssize
+){
+	int32 now,rate;
+
+	rate = 0;
+	if(tcb->cc->rate != NULL)
+		rate = (*tcb->cc->rate)(tcb);
+	if(rate == 0 && tcb->srtt != 0)
+		rate = (tcb->cwind * 1000L) / tcb->srtt;
+	if(tcb->cwind < tcb->ssthresh)
+		rate *= 2;
+	else
+		rate += rate / 4;
+	if((tcb->pacerate = rate) == 0)
+		return;
+	now = msclock();
+	if(tcb->pacenext - now < -MSPTICK)
+		tcb->pacenext = now - MSPTICK;
+	tcb->pacenext += (ssize * 1000L) / rate;
+}
+/* Describe the resequencing queue in SACK blocks, the block holding the
+ * latest arrival first (RFC 2018). Send as many as fit with timestamps
+ * and without pushing a segment carrying data past the MSS, which
+ * already allows for timestamps.
+ */
+static void
+sack_blocks(
+struct tcb *tcb,
+struct tcp *seg,
+uint16 ssize
+){
+	register struct reseq *rp;
+	struct sackblk blk;
+	int32 end;
+	int max,pass,latest,placed;
+
+	max = MAXSACK;
+	if(seg->flags.tstamp)
+		max = (TCP_MAXOPT - ((TSTAMP_LENGTH + 3) & ~3) - 4) / 8;
+	if(ssize != 0){
+		if(tcb->mss < ssize + 2 + SACK_LENGTH(1))
+			return;
+		max = min(max,(int)((tcb->mss - ssize - 4) / 8));
+	}
+	seg->nsack = 0;
+	placed = 0;
+	for(pass=0;pass<2;pass++){
+		rp = tcb->reseq;
+		while(rp != NULL && seg->nsack < max){
+			/* Coalesce entries that overlap or abut */
+			blk.start = rp->seq;
+			blk.end = blk.start;
+			for(;rp != NULL && seq_le(rp->seq,blk.end);rp = rp->next){
+				end = rp->end + rp->fin;
+				if(seq_gt(end,blk.end))
+					blk.end = end;
+			}
+			if(seq_lt(blk.start,tcb->rcv.nxt))
+				blk.start = tcb->rcv.nxt;
+			if(!seq_lt(blk.start,blk.end))
+				continue;	/* Already received in order */
+			latest = seq_ge(tcb->sackin,blk.start)
+			 && seq_lt(tcb->sackin,blk.end);
+			if(pass == 0 ? latest : !(latest && placed)){
+				ASSIGN(seg->sack[seg->nsack],blk);
+				seg->nsack++;
+				if(pass == 0){
+					placed = 1;
+					break;
+				}
+			}
+		}
 	}
+	Tcpsackout += seg->nsack;
 }
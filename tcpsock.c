@@ -7,6 +7,7 @@ static void s_trcall(struct tcb *tcb,int32 cnt);
 static void s_tscall(struct tcb *tcb,int old,int new);
 static void s_ttcall(struct tcb *tcb,int32 cnt);
 static void trdiscard(struct tcb *tcb,int32 cnt);
+static void trtimewait(struct tcb *tcb);
 static void autobind(struct usock *up);
 
 uint16 Lport = 1024;
@@ -168,6 +169,8 @@ so_tcp_shut(struct usock *up,int how)
 	switch(how){
 	case 0:	/* No more receives -- replace upcall */
 		up->cb.tcb->r_upcall = trdiscard;
+		up->cb.tcb->flags.rclosed = 1;
+		trtimewait(up->cb.tcb);
 		break;
 	case 1:	/* Send EOF */
 		close_tcp(up->cb.tcb);
@@ -182,11 +185,17 @@ so_tcp_shut(struct usock *up,int how)
 int
 so_tcp_close(struct usock *up)
 {
-	if(up->cb.tcb != NULL){	/* In case it's been reset */
-		up->cb.tcb->r_upcall = trdiscard;
+	struct tcb *tcb;
+
+	if((tcb = up->cb.tcb) != NULL){	/* In case it's been reset */
+		tcb->r_upcall = trdiscard;
+		tcb->flags.rclosed = 1;
 		/* Tell the TCP_CLOSED upcall there's no more socket */
-		up->cb.tcb->user = -1;
-		close_tcp(up->cb.tcb);
+		tcb->user = -1;
+		if(tcb->state == TCP_TIME_WAIT)
+			trtimewait(tcb);
+		else
+			close_tcp(tcb);
 	}
 	return 0;
 }
@@ -299,6 +308,19 @@ trdiscard(struct tcb *tcb,int32 cnt)
 	recv_tcp(tcb,&bp,cnt);
 	free_p(&bp);
 }
+/* Once the receive side has been shut down, a TCB left in TIME_WAIT
+ * while its data was unread can give up its unread data and be traded
+ * for a compact record
+ */
+static void
+trtimewait(struct tcb *tcb)
+{
+	if(tcb->state != TCP_TIME_WAIT)
+		return;
+	if(tcb->rcvcnt != 0)
+		trdiscard(tcb,0);
+	tcp_timewait(tcb);
+}
 
 /* Issue an automatic bind of a local address */
 static void
@@ -40,6 +40,40 @@ char *Tcpreasons[] = {
 	"ICMP"		/* Not actually used */
 };
 struct tcb *Tcbs;		/* Head of control block list */
+unsigned Ntcbs;			/* Number of control blocks on list */
+
+/* Control blocks are also hashed for lookup. Connections with a
+ * specified remote socket are hashed on all four address and port
+ * fields into Tcbtab; it starts with TCBHASH chains and is grown by a
+ * factor of four whenever there are more than twice as many control
+ * blocks as chains. Listeners with an unspecified remote socket are
+ * hashed on the local port alone into Tcblisten, so a listener with
+ * an unspecified local address shares a chain with any listeners on
+ * specific addresses for the same port.
+ */
+#define	TCBHASH		16	/* Initial connection chains, power of 2 */
+#define	MAXTCBHASH	1024	/* Largest connection hash table */
+#define	LISTENHASH	16	/* Listener chains, power of 2 */
+static struct tcb *Tcbinit[TCBHASH];
+static struct tcb **Tcbtab = Tcbinit;
+unsigned Ntcbhash = TCBHASH;
+static struct tcb *Tcblisten[LISTENHASH];
+int32 Tcblookups;
+int32 Tcbprobes;
+int32 Tcptimeouts;
+int32 Tcpsackout;
+int32 Tcpsackin;
+int32 Tcpsackholes;
+int32 Tcpsackbytes;
+int32 Tcpsackrecov;
+int32 Tcppaced;
+int32 Tcpackheld;
+int32 Tcpacktimer;
+int32 Tcpackcarry;
+int32 Tcpackstretch;
+
+static struct tcb **tcb_chain(struct connection *conn);
+static void tcb_rehash(unsigned size);
 uint16 Tcp_mss = DEF_MSS;	/* Maximum segment size to be sent with SYN */
 int32 Tcp_irtt = DEF_RTT;	/* Initial guess at round trip time */
 int Tcp_trace;			/* State change tracing flag */
@@ -65,28 +99,51 @@ struct mib_entry Tcp_mib[] = {
 };
 
 
+/* Return the hash chain on which a connection belongs */
+static struct tcb **
+tcb_chain(conn)
+register struct connection *conn;
+{
+	register uint16 x;
+
+	if(conn->remote.address == 0){
+		/* Listener */
+		x = conn->local.port;
+		x ^= x >> 8;
+		return &Tcblisten[x & (LISTENHASH-1)];
+	}
+	x = hiword(conn->remote.address) ^ loword(conn->remote.address)
+	 ^ hiword(conn->local.address) ^ loword(conn->local.address)
+	 ^ conn->remote.port ^ (conn->local.port << 5);
+	x ^= (x >> 10) ^ (x >> 5);
+	return &Tcbtab[x & (Ntcbhash-1)];
+}
 /* Look up TCP connection
  * Return TCB pointer or NULL if nonexistant.
- * Also move the entry to the top of the list to speed future searches.
+ * Also move the entry to the top of its hash chain to speed future searches.
  */
 struct tcb *
 lookup_tcb(conn)
 register struct connection *conn;
 {
 	register struct tcb *tcb;
+	struct tcb **chain;
 	struct tcb *tcblast = NULL;
 
-	for(tcb=Tcbs;tcb != NULL;tcblast = tcb,tcb = tcb->next){
+	Tcblookups++;
+	chain = tcb_chain(conn);
+	for(tcb = *chain;tcb != NULL;tcblast = tcb,tcb = tcb->hnext){
+		Tcbprobes++;
 		/* Yet another structure compatibility hack */
 		if(conn->remote.port == tcb->conn.remote.port
 		 && conn->local.port == tcb->conn.local.port
 		 && conn->remote.address == tcb->conn.remote.address
 		 && conn->local.address == tcb->conn.local.address){
 			if(tcblast != NULL){
-				/* Move to top of list */
-				tcblast->next = tcb->next;
-				tcb->next = Tcbs;
-				Tcbs = tcb;
+				/* Move to top of chain */
+				tcblast->hnext = tcb->hnext;
+				tcb->hnext = *chain;
+				*chain = tcb;
 			}
 			return tcb;
 		}
@@ -94,6 +151,83 @@ register struct connection *conn;
 	}
 	return NULL;
 }
+/* Put a TCB on the list and hash it on its connection. Must be called
+ * again (after unlink_tcb) whenever the connection fields change.
+ */
+void
+link_tcb(tcb)
+register struct tcb *tcb;
+{
+	struct tcb **chain;
+
+	if(++Ntcbs > 2*Ntcbhash && Ntcbhash < MAXTCBHASH)
+		tcb_rehash(4*Ntcbhash);
+	tcb->prev = NULL;
+	if((tcb->next = Tcbs) != NULL)
+		tcb->next->prev = tcb;
+	Tcbs = tcb;
+	chain = tcb_chain(&tcb->conn);
+	tcb->hnext = *chain;
+	*chain = tcb;
+}
+/* Take a TCB off the list and out of the hash table.
+ * Return -1 if it wasn't there.
+ */
+int
+unlink_tcb(tcb)
+register struct tcb *tcb;
+{
+	register struct tcb **tpp;
+
+	if(tcb == NULL)
+		return -1;
+	for(tpp = tcb_chain(&tcb->conn);*tpp != NULL;tpp = &(*tpp)->hnext)
+		if(*tpp == tcb)
+			break;
+	if(*tpp == NULL)
+		return -1;
+	*tpp = tcb->hnext;
+	tcb->hnext = NULL;
+
+	if(tcb->prev != NULL)
+		tcb->prev->next = tcb->next;
+	else
+		Tcbs = tcb->next;
+	if(tcb->next != NULL)
+		tcb->next->prev = tcb->prev;
+	tcb->next = tcb->prev = NULL;
+	Ntcbs--;
+	return 0;
+}
+/* Move the connection chains into a bigger hash table.
+ * If there isn't memory for it, just keep using the old one.
+ */
+static void
+tcb_rehash(size)
+unsigned size;
+{
+	struct tcb **oldtab,**newtab,**chain;
+	register struct tcb *tcb;
+	struct tcb *tnext;
+	unsigned i,oldsize;
+
+	if((newtab = (struct tcb **)calloc(size,sizeof(struct tcb *))) == NULL)
+		return;
+	oldtab = Tcbtab;
+	oldsize = Ntcbhash;
+	Tcbtab = newtab;
+	Ntcbhash = size;
+	for(i=0;i<oldsize;i++){
+		for(tcb = oldtab[i];tcb != NULL;tcb = tnext){
+			tnext = tcb->hnext;
+			chain = tcb_chain(&tcb->conn);
+			tcb->hnext = *chain;
+			*chain = tcb;
+		}
+	}
+	if(oldtab != Tcbinit)
+		free(oldtab);
+}
 
 /* Create a TCB, return pointer. Return pointer if TCB already exists. */
 struct tcb *
@@ -111,6 +245,7 @@ struct connection *conn;
 	tcb->state = TCP_CLOSED;
 	tcb->cwind = tcb->mss = Tcp_mss;
 	tcb->ssthresh = 65535;
+	tcb->cc = Tcp_cc;	/* Until the route is known */
 	if((tp = rtt_get(tcb->conn.remote.address)) != NULL){
 		tcb->srtt = tp->srtt;
 		tcb->mdev = tp->mdev;
@@ -119,14 +254,28 @@ struct connection *conn;
 	}
 	/* Initialize timer intervals */
 	set_timer(&tcb->timer,tcb->srtt);
-	tcb->timer.func = tcp_timeout;
-	tcb->timer.arg = tcb;
+	tcb_timers(tcb);
 
-	tcb->next = Tcbs;
-	Tcbs = tcb;		
+	link_tcb(tcb);
 	return tcb;
 }
 
+/* Point the timers in a new or freshly cloned TCB at that TCB.
+ * A clone gets its copies of the listener's timers stopped and unlinked.
+ */
+void
+tcb_timers(tcb)
+register struct tcb *tcb;
+{
+	tcb->timer.func = tcp_timeout;
+	tcb->timer.arg = tcb;
+	tcb->pacer.func = tcp_pacer;
+	tcb->pacer.arg = tcb;
+	tcb->acker.func = tcp_acker;
+	tcb->acker.arg = tcb;
+	tcb->timer.state = tcb->pacer.state = tcb->acker.state = TIMER_STOP;
+	tcb->timer.pprev = tcb->pacer.pprev = tcb->acker.pprev = NULL;
+}
 /* Close our TCB */
 void
 close_self(tcb,reason)
@@ -140,6 +289,8 @@ int reason;
 		return;
 
 	stop_timer(&tcb->timer);
+	stop_timer(&tcb->pacer);
+	stop_timer(&tcb->acker);
 	tcb->reason = reason;
 
 	/* Flush reassembly queue; nothing more can arrive */
@@ -312,6 +463,7 @@ int red;
 {
 	register struct tcb *tcb;
 	struct reseq *rp,*rp1;
+	struct mbuf *bp;
 
 	for(tcb = Tcbs;tcb != NULL;tcb = tcb->next){
 		mbuf_crunch(&tcb->rcvq);
@@ -321,11 +473,15 @@ int red;
 			if(red){
 				free_p(&rp->bp);
 				free(rp);
-			} else {
+			} else if(rp->bp != NULL){
 				mbuf_crunch(&rp->bp);
+				for(bp = rp->bp;bp != NULL && bp->next != NULL;)
+					bp = bp->next;
+				rp->tail = bp;
 			}
 		}
 		if(red)
 			tcb->reseq = NULL;
 	}
+	tcp_twgarbage(red);
 }
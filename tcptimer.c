@@ -30,13 +30,17 @@ void *p;
 		break;
 	default:		/* Retransmission timer has expired */
 		tcb->timeouts++;
+		Tcptimeouts++;
+		/* The receiver may have discarded what it selectively
+		 * acked (RFC 2018), so start the scoreboard over
+		 */
+		tcb->nsacked = 0;
 		tcb->flags.retran = 1;	/* Indicate > 1  transmission */
 		tcb->backoff++;
-		/* Reduce slowstart threshold to half current window */
-		tcb->ssthresh = tcb->cwind / 2;
-		tcb->ssthresh = max(tcb->ssthresh,tcb->mss);
-		/* Shrink congestion window to 1 packet */
-		tcb->cwind = tcb->mss;
+		/* Reduce slowstart threshold and shrink the congestion
+		 * window as the congestion control module sees fit
+		 */
+		(*tcb->cc->rto)(tcb);
 		/* Retransmit just the oldest unacked packet */
 		ptrsave = tcb->snd.ptr;
 		tcb->snd.ptr = tcb->snd.una;
@@ -44,6 +48,19 @@ void *p;
 		tcb->snd.ptr = ptrsave;
 	}
 }
+/* Delayed ACK timer expiration: send the ACK we've been holding */
+void
+tcp_acker(
+void *p
+){
+	register struct tcb *tcb = p;
+
+	if(tcb == NULL || tcb->ackpend == 0)
+		return;
+	Tcpacktimer++;
+	tcb->flags.force = 1;
+	tcp_output(tcb);
+}
 /* Backoff function - the subject of much research */
 int32
 backoff(n)
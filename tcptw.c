@@ -0,0 +1,262 @@
+/* Compact TIME_WAIT handling. When a connection enters TIME_WAIT, the
+ * little that's needed to answer retransmitted FINs (the connection,
+ * the final sequence numbers and an expiration time) is copied into a
+ * tcptw record and the TCB is closed, so the user can free it at once.
+ * Since every record lives for the same 2MSL, the records are kept on
+ * a list in order of expiration and a single timer serves them all.
+ *
+ * Copyright 1991 Phil Karn, KA9Q
+ */
+#include "global.h"
+#include "timer.h"
+#include "mbuf.h"
+#include "netuser.h"
+#include "internet.h"
+#include "tcp.h"
+#include "ip.h"
+
+#define	TWHASH	64	/* TIME_WAIT hash chains, power of 2 */
+#define	TWLIFE	(MSL2*1000L)	/* Record lifetime, ms */
+
+static struct tcptw *Twtab[TWHASH];	/* Hash chains */
+static struct tcptw *Twhead;		/* Oldest record */
+static struct tcptw *Twtail;		/* Newest record */
+static struct timer Twtimer;		/* Expiration timer for Twhead */
+
+unsigned Ntcptw;		/* Records in use */
+int32 Tcptwmax = 512;		/* Limit on same */
+int32 Tcptws;			/* Connections traded in for records */
+int32 Tcptwacks;		/* ACKs sent from records */
+int32 Tcptwreuse;		/* Records given up to a new SYN */
+int32 Tcptwdrops;		/* Records freed before expiring */
+
+static struct tcptw **tw_chain(struct connection *conn);
+static void tw_append(struct tcptw *tw);
+static void tw_free(struct tcptw *tw);
+static void tw_ack(struct tcptw *tw);
+static void tw_timeout(void *p);
+static void tw_rearm(void);
+
+/* Trade a TCB in TIME_WAIT for a compact record and close it. This is
+ * only done once the user will read no more from it, since closing the
+ * TCB takes the receive queue with it; until then, and if there's no
+ * memory for the record, the TCB times out on its own.
+ */
+void
+tcp_timewait(
+struct tcb *tcb
+){
+	register struct tcptw *tw;
+	struct tcptw **chain;
+
+	if(tcb->state != TCP_TIME_WAIT || tcb->rcvcnt != 0
+	 || (tcb->user != -1 && !tcb->flags.rclosed))
+		return;
+	if((tw = (struct tcptw *)malloc(sizeof(struct tcptw))) == NULL)
+		return;
+	ASSIGN(tw->conn,tcb->conn);
+	tw->snd_nxt = tcb->snd.nxt;
+	tw->rcv_nxt = tcb->rcv.nxt;
+	tw->tos = tcb->tos;
+	tw->ts_ok = tcb->flags.ts_ok;
+	tw->ts_recent = tcb->ts_recent;
+	if(tcb->flags.ws_ok)
+		tw->wnd = tcb->rcv.wnd >> tcb->rcv.wind_scale;
+	else
+		tw->wnd = tcb->rcv.wnd;
+	chain = tw_chain(&tw->conn);
+	tw->hnext = *chain;
+	*chain = tw;
+	tw_append(tw);
+	Ntcptw++;
+	Tcptws++;
+	/* Recycle the oldest records rather than grow without bound */
+	while(Ntcptw > Tcptwmax && Twhead != tw){
+		tw_free(Twhead);
+		Tcptwdrops++;
+	}
+	tw_rearm();
+
+	close_self(tcb,NORMAL);	/* The user will normally delete it */
+}
+/* Offer an incoming segment for which there's no live connection to the
+ * TIME_WAIT records. Return 0 if a record took it, -1 if the segment
+ * should be processed normally.
+ */
+int
+tcp_twinput(
+struct tcp *seg,
+struct connection *conn,
+struct mbuf **bpp,
+uint16 length
+){
+	register struct tcptw *tw;
+
+	for(tw = *tw_chain(conn);tw != NULL;tw = tw->hnext){
+		if(conn->remote.port == tw->conn.remote.port
+		 && conn->local.port == tw->conn.local.port
+		 && conn->remote.address == tw->conn.remote.address
+		 && conn->local.address == tw->conn.local.address)
+			break;
+	}
+	if(tw == NULL)
+		return -1;
+	if(seg->flags.rst){
+		/* Connection reset; forget it (p 70) */
+		tw_free(tw);
+		Tcptwdrops++;
+		free_p(bpp);
+		return 0;
+	}
+	if(seg->flags.syn && !seg->flags.ack && seq_gt(seg->seq,tw->rcv_nxt)){
+		/* A new incarnation of the connection can't be confused
+		 * with the old one; let a listener have it
+		 */
+		tw_free(tw);
+		Tcptwreuse++;
+		return -1;
+	}
+	/* Update timestamp field (RFC 7323 4.3) */
+	if(tw->ts_ok && seg->flags.tstamp && seq_le(seg->seq,tw->rcv_nxt))
+		tw->ts_recent = seg->tsval;
+	if(seg->flags.fin){
+		/* Retransmitted FIN; restart the 2MSL timer (p 76) */
+		if(tw->prev != NULL)
+			tw->prev->next = tw->next;
+		else
+			Twhead = tw->next;
+		if(tw->next != NULL)
+			tw->next->prev = tw->prev;
+		else
+			Twtail = tw->prev;
+		tw_append(tw);
+		tw_rearm();
+	}
+	if(length != 0 || seg->flags.syn || seg->flags.fin)
+		tw_ack(tw);
+	free_p(bpp);
+	return 0;
+}
+/* TCP garbage collection of TIME_WAIT records; in red alert, give them
+ * all up. Peers whose final ACK is lost will just get a reset.
+ */
+void
+tcp_twgarbage(
+int red
+){
+	if(!red)
+		return;
+	while(Twhead != NULL){
+		tw_free(Twhead);
+		Tcptwdrops++;
+	}
+	stop_timer(&Twtimer);
+}
+/* Return the hash chain on which a connection belongs */
+static struct tcptw **
+tw_chain(
+register struct connection *conn
+){
+	register uint16 x;
+
+	x = hiword(conn->remote.address) ^ loword(conn->remote.address)
+	 ^ loword(conn->local.address) ^ conn->remote.port
+	 ^ (conn->local.port << 5);
+	x ^= (x >> 10) ^ (x >> 5);
+	return &Twtab[x & (TWHASH-1)];
+}
+/* Put a record on the end of the expiration list with a full lifetime */
+static void
+tw_append(
+register struct tcptw *tw
+){
+	tw->expires = msclock() + TWLIFE;
+	tw->next = NULL;
+	if((tw->prev = Twtail) != NULL)
+		Twtail->next = tw;
+	else
+		Twhead = tw;
+	Twtail = tw;
+}
+/* Unlink and free a record */
+static void
+tw_free(
+register struct tcptw *tw
+){
+	register struct tcptw **twp;
+
+	for(twp = tw_chain(&tw->conn);*twp != NULL;twp = &(*twp)->hnext){
+		if(*twp == tw){
+			*twp = tw->hnext;
+			break;
+		}
+	}
+	if(tw->prev != NULL)
+		tw->prev->next = tw->next;
+	else
+		Twhead = tw->next;
+	if(tw->next != NULL)
+		tw->next->prev = tw->prev;
+	else
+		Twtail = tw->prev;
+	Ntcptw--;
+	free(tw);
+}
+/* Send an ACK of the peer's FIN, with a timestamp if they were in use */
+static void
+tw_ack(
+struct tcptw *tw
+){
+	struct tcp seg;
+	struct mbuf *hbp;
+
+	memset(&seg,0,sizeof(seg));
+	seg.source = tw->conn.local.port;
+	seg.dest = tw->conn.remote.port;
+	seg.seq = tw->snd_nxt;
+	seg.ack = tw->rcv_nxt;
+	seg.flags.ack = 1;
+	seg.wnd = tw->wnd;
+	if(tw->ts_ok){
+		seg.flags.tstamp = 1;
+		seg.tsval = msclock();
+		seg.tsecr = tw->ts_recent;
+	}
+
+	hbp = NULL;
+	hdrroom(&hbp,TCPLEN + TCP_MAXOPT + ip_hdrroom(tw->conn.remote.address));
+	htontcp(&seg,&hbp,tw->conn.local.address,tw->conn.remote.address);
+	ip_send(tw->conn.local.address,tw->conn.remote.address,TCP_PTCL,
+	 tw->tos,0,&hbp,len_p(hbp),0,0);
+	tcpOutSegs++;
+	Tcptwacks++;
+}
+/* Free the records that have expired and wait for the next one */
+static void
+tw_timeout(
+void *p
+){
+	int32 now;
+
+	now = msclock();
+	while(Twhead != NULL && Twhead->expires - now <= 0)
+		tw_free(Twhead);
+	tw_rearm();
+}
+/* Run the timer until the oldest record expires */
+static void
+tw_rearm()
+{
+	int32 left;
+
+	stop_timer(&Twtimer);
+	if(Twhead == NULL)
+		return;
+	if((left = Twhead->expires - msclock()) < 1)
+		left = 1;
+	Twtimer.func = tw_timeout;
+	Twtimer.arg = NULL;
+	set_timer(&Twtimer,left);
+	set_timer_slack(&Twtimer,1000L);
+	start_timer(&Twtimer);
+}
@@ -234,24 +234,18 @@ int
 del_tcp(conn)
 struct tcb *conn;
 {
-	register struct tcb *tcb;
-	struct tcb *tcblast = NULL;
+	register struct tcb *tcb = conn;
 	struct reseq *rp,*rp1;
 
 	/* Remove from list */
-	for(tcb=Tcbs;tcb != NULL;tcblast = tcb,tcb = tcb->next)
-		if(tcb == conn)
-			break;
-	if(tcb == NULL){
+	if(unlink_tcb(tcb) == -1){
 		Net_error = INVALID;
 		return -1;	/* conn was NULL, or not on list */ 
 	}
-	if(tcblast != NULL)
-		tcblast->next = tcb->next;
-	else
-		Tcbs = tcb->next;	/* was first on list */
 
 	stop_timer(&tcb->timer);
+	stop_timer(&tcb->pacer);
+	stop_timer(&tcb->acker);
 	for(rp = tcb->reseq;rp != NULL;rp = rp1){
 		rp1 = rp->next;
 		free_p(&rp->bp);
@@ -11,13 +11,48 @@
 #include "hardware.h"
 #include "socket.h"
 
-/* Head of running timer chain.
- * The list of running timers is sorted in increasing order of expiration;
- * i.e., the first timer to expire is always at the head of the list.
+/* Running timers are kept on a hierarchical timing wheel, so starting and
+ * stopping a timer takes constant time no matter how many are running.
+ * Tv1 has a slot for each of the next TVR_SIZE ticks. Each level of Tvn
+ * covers TVN_SIZE times the span of the level below it; when Tv1 wraps,
+ * the next slot of the first level is redistributed ("cascaded") into the
+ * levels below, and so on up. Together the levels span the full 32-bit
+ * clock, so expiration times still compare with wraparound-safe
+ * subtraction.
  */
-static struct timer *Timers;
+#define	TVR_BITS	8
+#define	TVN_BITS	6
+#define	NTVN		4	/* TVR_BITS + NTVN*TVN_BITS == 32 */
+#define	TVR_SIZE	(1 << TVR_BITS)
+#define	TVN_SIZE	(1 << TVN_BITS)
+#define	TVR_MASK	(TVR_SIZE-1)
+#define	TVN_MASK	(TVN_SIZE-1)
+#define	TVSHIFT(i)	(TVR_BITS + (i)*TVN_BITS)
+
+static struct timer *Tv1[TVR_SIZE];
+static struct timer *Tvn[NTVN][TVN_SIZE];
+static int32 Wheelclock;	/* Next tick to be processed */
+static int Ntimers;		/* Timers on the wheel */
+static struct timer *Expired;	/* Expired, notify function not yet called */
+
+/* No timer expires and no cascade is needed before Nextdue, so until
+ * then timerproc() can skip the wheel and the extra context switch.
+ * Timers with slack are rounded up to a multiple of a power of two
+ * ticks so they tend to come due on the same tick.
+ */
+static int32 Nextdue;
+static int32 Tpasses;		/* Ticks handled by timerproc */
+static int32 Tidle;		/* Of those, ticks with nothing due */
+static int32 Tfired;		/* Timers expired */
+static int32 Tbatches;		/* Ticks on which any timer expired */
 
 static void t_alarm(void *x);
+static void tlink(struct timer **head,struct timer *t);
+static void tunlink(struct timer *t);
+static void tdetach(struct timer *t);
+static void wheel_add(struct timer *t);
+static void wheel_tick(struct timer **expired);
+static void wheel_next(void);
 
 /* Process that handles clock ticks */
 void
@@ -26,7 +61,6 @@ int i;
 void *v1,*v2;
 {
 	register struct timer *t;
-	register struct timer *expired;
 	void (**vf)(void);
 	int i_state;
 	int tmp;
@@ -56,38 +90,39 @@ void *v1,*v2;
 
 		kwait(NULL);	/* Let them all do their writes */
 
-		if(Timers == NULL)
-			continue;	/* No active timers, all done */
-
-		/* Initialize null expired timer list */
-		expired = NULL;
 		clock = rdclock();
-
-		/* Move expired timers to expired list. Note use of
+		Tpasses++;
+		if(Ntimers == 0){
+			Wheelclock = clock;
+			Tidle++;
+			continue;	/* No active timers, all done */
+		}
+		if((clock - Nextdue) < 0){
+			/* The slots in between are known to be empty */
+			Wheelclock = clock + 1;
+			Tidle++;
+			continue;
+		}
+		/* Move the timers in every slot up to and including the
+		 * current tick to the expired list. Note use of
 		 * subtraction and comparison to zero rather than the
 		 * more obvious simple comparison; this avoids
 		 * problems when the clock count wraps around.
 		 */
-		while(Timers != NULL && (clock - Timers->expiration) >= 0){
-			if(Timers->next == Timers){
-				printf("PANIC: Timer loop at %lx\n",
-				 (long)Timers);
-				iostop();
-				exit(1);
-			}
-			/* Save Timers since stop_timer will change it */
-			t = Timers;
-			stop_timer(t);
-			t->state = TIMER_EXPIRE;
-			/* Add to expired timer list */
-			t->next = expired;
-			expired = t;
-		}
+		while((clock - Wheelclock) >= 0)
+			wheel_tick(&Expired);
+		wheel_next();
+		if(Expired == NULL)
+			continue;	/* Only cascaded */
+		Tbatches++;
+
 		/* Now go through the list of expired timers, removing each
-		 * one and kicking the notify function, if there is one
+		 * one and kicking the notify function, if there is one.
+		 * A timer stopped or restarted by an earlier notify
+		 * function is taken off this list.
 		 */
-		while((t = expired) != NULL){
-			expired = t->next;
+		while((t = Expired) != NULL){
+			tunlink(t);
 			if(t->func){
 				(*t->func)(t->arg);
 			}
@@ -100,64 +135,160 @@ void
 start_timer(t)
 struct timer *t;
 {
-	register struct timer *tnext;
-	struct timer *tprev = NULL;
+	int32 g;
 
 	if(t == NULL)
 		return;
-	if(t->state == TIMER_RUN)
-		stop_timer(t);
+	tdetach(t);	/* Also supersedes a pending expiration */
+	t->state = TIMER_STOP;
 	if(t->duration == 0)
 		return;		/* A duration value of 0 disables the timer */
 
+	if(Ntimers == 0)
+		Wheelclock = rdclock();	/* Wheel may not have been kept up */
 	t->expiration = rdclock() + t->duration;
+	if(t->slack > 1){
+		/* Round up to the largest power of two within the slack */
+		for(g = 1;2*g <= t->slack;g <<= 1)
+			;
+		t->expiration = (t->expiration + g - 1) & ~(g - 1);
+	}
 	t->state = TIMER_RUN;
-
-	/* Find right place on list for this guy. Once again, note use
-	 * of subtraction and comparison with zero rather than direct
-	 * comparison of expiration times.
-	 */
-	for(tnext = Timers;tnext != NULL;tprev=tnext,tnext = tnext->next){
-		if((tnext->expiration - t->expiration) >= 0)
-			break;
+	wheel_add(t);
+	if(Ntimers++ == 0){
+		/* A far timer went into Tvn[], so the wheel must not be
+		 * skipped past the next cascade either
+		 */
+		Nextdue = (Wheelclock + TVR_MASK) & ~(int32)TVR_MASK;
 	}
-	/* At this point, tprev points to the entry that should go right
-	 * before us, and tnext points to the entry just after us. Either or
-	 * both may be null.
-	 */
-	if(tprev == NULL)
-		Timers = t;		/* Put at beginning */
-	else
-		tprev->next = t;
-
-	t->next = tnext;
+	if((t->expiration - Nextdue) < 0)
+		Nextdue = t->expiration;
 }
-/* Stop a timer */
+/* Stop a timer. One that has expired but whose notify function
+ * hasn't yet been called is cancelled.
+ */
 void
 stop_timer(timer)
 struct timer *timer;
 {
-	register struct timer *t;
-	struct timer *tlast = NULL;
-
-	if(timer == NULL || timer->state != TIMER_RUN)
+	if(timer == NULL)
 		return;
+	tdetach(timer);
+	timer->state = TIMER_STOP;
+}
+/* Take a timer off the wheel or the expired list, if it's really on one.
+ * The state alone can't be trusted to say which, since some callers set
+ * it by hand (e.g., to TIMER_STOP on a timer still on the expired list).
+ */
+static void
+tdetach(t)
+struct timer *t;
+{
+	register struct timer *tp;
 
-	/* Verify that timer is really on list */
-	for(t = Timers;t != NULL;tlast = t,t = t->next)
-		if(t == timer)
-			break;
+	if(t->pprev == NULL || *t->pprev != t)
+		return;		/* Not on any list */
+	tp = NULL;
+	if(t->state != TIMER_RUN){
+		for(tp = Expired;tp != NULL && tp != t;tp = tp->next)
+			;
+	}
+	tunlink(t);
+	if(tp == NULL)
+		Ntimers--;	/* Was on the wheel */
+}
+/* Put a timer at the head of a list */
+static void
+tlink(head,t)
+struct timer **head;
+struct timer *t;
+{
+	if((t->next = *head) != NULL)
+		t->next->pprev = &t->next;
+	*head = t;
+	t->pprev = head;
+}
+/* Take a timer off whatever list it's on */
+static void
+tunlink(t)
+struct timer *t;
+{
+	if(t->next != NULL)
+		t->next->pprev = t->pprev;
+	*t->pprev = t->next;
+	t->next = NULL;
+	t->pprev = NULL;
+}
+/* Put a running timer in the right slot of the wheel */
+static void
+wheel_add(t)
+struct timer *t;
+{
+	int32 delta;
+	int i;
 
-	if(t == NULL)
-		return;		/* Should probably panic here */
+	delta = t->expiration - Wheelclock;
+	if(delta < 0){
+		/* Already due; catch it on the next tick processed */
+		tlink(&Tv1[(int)(Wheelclock & TVR_MASK)],t);
+	} else if(delta < TVR_SIZE){
+		tlink(&Tv1[(int)(t->expiration & TVR_MASK)],t);
+	} else {
+		for(i=0;i<NTVN-1 && delta >= (1L << TVSHIFT(i+1));i++)
+			;
+		tlink(&Tvn[i][(int)((t->expiration >> TVSHIFT(i)) & TVN_MASK)],t);
+	}
+}
+/* Process one tick of the wheel, moving the timers due on it to the
+ * expired list
+ */
+static void
+wheel_tick(expired)
+struct timer **expired;
+{
+	struct timer *t,*head;
+	int i,idx;
 
-	/* Delete from active timer list */
-	if(tlast != NULL)
-		tlast->next = t->next;
-	else
-		Timers = t->next;	/* Was first on list */
+	idx = (int)(Wheelclock & TVR_MASK);
+	if(idx == 0){
+		/* Tv1 has wrapped; cascade the next slot of each level
+		 * down until one that hasn't wrapped
+		 */
+		for(i=0;i<NTVN;i++){
+			idx = (int)((Wheelclock >> TVSHIFT(i)) & TVN_MASK);
+			head = Tvn[i][idx];
+			Tvn[i][idx] = NULL;
+			while((t = head) != NULL){
+				head = t->next;
+				wheel_add(t);
+			}
+			if(idx != 0)
+				break;
+		}
+		idx = 0;
+	}
+	while((t = Tv1[idx]) != NULL){
+		tunlink(t);
+		t->state = TIMER_EXPIRE;
+		tlink(expired,t);
+		Ntimers--;
+		Tfired++;
+	}
+	Wheelclock++;
+}
+/* Find the next tick needing attention: the next nonempty slot of Tv1,
+ * or the next cascade, whichever comes first
+ */
+static void
+wheel_next()
+{
+	int32 tick;
 
-	t->state = TIMER_STOP;
+	for(tick = Wheelclock;;tick++){
+		if((tick & TVR_MASK) == 0 || Tv1[(int)(tick & TVR_MASK)] != NULL)
+			break;
+	}
+	Nextdue = tick;
 }
 /* Return milliseconds remaining on this timer */
 int32
@@ -190,6 +321,26 @@ int32 interval;
 		t->duration = 1 + (interval + MSPTICK - 1)/MSPTICK;
 	else
 		t->duration = 0;
+	t->slack = 0;
+}
+/* Let a timer expire up to this many milliseconds late, so it can be
+ * handled together with others. Must follow set_timer(), which clears it.
+ */
+void
+set_timer_slack(t,ms)
+struct timer *t;
+int32 ms;
+{
+	if(t == NULL)
+		return;
+	t->slack = ms / MSPTICK;
+}
+/* Display timer process statistics */
+void
+timerstat()
+{
+	printf("timers %d ticks %lu idle %lu fired %lu batches %lu\n",
+	 Ntimers,Tpasses,Tidle,Tfired,Tbatches);
 }
 /* Delay process for specified number of milliseconds.
  * Normally returns 0; returns -1 if aborted by alarm.
@@ -7,23 +7,24 @@
 
 /* Software timers
  * There is one of these structures for each simulated timer.
- * Whenever the timer is running, it is on a linked list
- * pointed to by "Timers". The list is sorted in ascending order of
- * expiration, with the first timer to expire at the head. This
- * allows the timer process to avoid having to scan the entire list
- * on every clock tick; once it finds an unexpired timer, it can
- * stop searching.
+ * Whenever the timer is running, it is on one of the slot lists of
+ * the timing wheel in timer.c, chosen by its expiration time, so
+ * that starting and stopping timers doesn't depend on how many
+ * are running. The timer process only has to look at the slot
+ * for the current tick.
  *
  * Stopping a timer or letting it expire causes it to be removed
- * from the list. Starting a timer puts it on the list at the right
- * place.
+ * from its list. Starting a timer puts it on the list for the slot
+ * covering its expiration.
  */
 struct timer {
 	struct timer *next;	/* Linked-list pointer */
+	struct timer **pprev;	/* Pointer to whatever points to us */
 	int32 duration;		/* Duration of timer, in ticks */
 	int32 expiration;	/* Clock time at expiration */
 	void (*func)(void *);	/* Function to call at expiration */
 	void *arg;		/* Arg to pass function */
+	int32 slack;		/* Extra delay tolerated, in ticks */
 	char state;		/* Timer state */
 #define	TIMER_STOP	0
 #define	TIMER_RUN	1
@@ -48,9 +49,11 @@ void kalarm(int32 ms);
 int ppause(int32 ms);
 int32 read_timer(struct timer *t);
 void set_timer(struct timer *t,int32 x);
+void set_timer_slack(struct timer *t,int32 ms);
 void start_timer(struct timer *t);
 void stop_timer(struct timer *timer);
 char *tformat(int32 t);
+void timerstat(void);
 
 /* In hardware.c: */
 int32 msclock(void);
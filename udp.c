@@ -22,6 +22,11 @@ struct mib_entry Udp_mib[] = {
 
 /* UDP control structures list */
 struct udp_cb *Udps;
+struct udp_cb *Udptab[UDPHASH];	/* Same, hashed on local port */
+int Udp_qlimit = 64;
+int32 Udplookups;
+int32 Udpprobes;
+int32 Udpqdrops;
 
 /* Create a UDP control block for lsocket, so that we can queue
  * incoming datagrams.
@@ -33,18 +38,27 @@ void (*r_upcall)();
 {
 	register struct udp_cb *up;
 
-	if((up = lookup_udp(lsocket)) != NULL){
-		/* Already exists */
-		Net_error = CON_EXISTS;
-		return NULL;
+	struct udp_cb **chain;
+
+	chain = &Udptab[udphash(lsocket->port)];
+	for(up = *chain;up != NULL;up = up->hnext){
+		if(up->socket.port == lsocket->port
+		 && up->socket.address == lsocket->address){
+			/* Already exists */
+			Net_error = CON_EXISTS;
+			return NULL;
+		}
 	}
 	up = (struct udp_cb *)callocw(1,sizeof (struct udp_cb));
 	up->socket.address = lsocket->address;
 	up->socket.port = lsocket->port;
 	up->r_upcall = r_upcall;
+	up->rcvlimit = Udp_qlimit;
 
 	up->next = Udps;
 	Udps = up;
+	up->hnext = *chain;
+	*chain = up;
 	return up;
 }
 
@@ -87,6 +101,8 @@ char df				/* Don't Fragment flag for IP */
 	ph.dest = fsocket->address;
 	ph.protocol = UDP_PTCL;
 
+	/* Leave room for all the headers ahead of the data */
+	hdrroom(bpp,UDPHDR + ip_hdrroom(fsocket->address));
 	htonudp(&udp,bpp,&ph);
 	udpOutDatagrams++;
 	ip_send(laddr,fsocket->address,UDP_PTCL,tos,ttl,bpp,length,id,df);
@@ -138,6 +154,7 @@ struct udp_cb *conn;
 	struct mbuf *bp;
 	register struct udp_cb *up;
 	struct udp_cb *udplast = NULL;
+	struct udp_cb **upp;
 
 	for(up = Udps;up != NULL;udplast = up,up = up->next){
 		if(up == conn)
@@ -155,11 +172,18 @@ struct udp_cb *conn;
 		free_p(&bp);
 		up->rcvcnt--;
 	}
-	/* Remove from list */
+	/* Remove from list and hash chain */
 	if(udplast != NULL)
 		udplast->next = up->next;
 	else
 		Udps = up->next;	/* was first on list */
+	for(upp = &Udptab[udphash(up->socket.port)];*upp != NULL;
+	 upp = &(*upp)->hnext){
+		if(*upp == up){
+			*upp = up->hnext;
+			break;
+		}
+	}
 
 	free(up);
 	return 0;
@@ -226,6 +250,14 @@ int32 said
 		free_p(bpp);
 		return;
 	}
+	if(up->rcvlimit != 0 && up->rcvcnt >= up->rcvlimit){
+		/* Reader isn't keeping up; don't let the queue grow */
+		up->drops++;
+		Udpqdrops++;
+		udpInErrors++;
+		free_p(bpp);
+		return;
+	}
 	/* Prepend the foreign socket info */
 	fsocket.address = ip->source;
 	fsocket.port = udp.source;
@@ -239,31 +271,28 @@ int32 said
 		(*up->r_upcall)(iface,up,up->rcvcnt);
 }
 /* Look up UDP socket. 
- * Return control block pointer or NULL if nonexistant
- * As side effect, move control block to top of list to speed future
- * searches.
+ * Return control block pointer or NULL if nonexistant.
+ * A control block bound to the specific address is preferred
+ * to one bound to INADDR_ANY.
  */
 static struct udp_cb *
 lookup_udp(socket)
 struct socket *socket;
 {
 	register struct udp_cb *up;
-	struct udp_cb *uplast = NULL;
+	struct udp_cb *wild = NULL;
 
-	for(up = Udps;up != NULL;uplast = up,up = up->next){
-		if(socket->port == up->socket.port
-		 && (socket->address == up->socket.address
-		 || up->socket.address == INADDR_ANY)){
-			if(uplast != NULL){
-				/* Move to top of list */
-				uplast->next = up->next;
-				up->next = Udps;
-				Udps = up;
-			}
+	Udplookups++;
+	for(up = Udptab[udphash(socket->port)];up != NULL;up = up->hnext){
+		Udpprobes++;
+		if(socket->port != up->socket.port)
+			continue;
+		if(socket->address == up->socket.address)
 			return up;
-		}
+		if(up->socket.address == INADDR_ANY)
+			wild = up;
 	}
-	return NULL;
+	return wild;
 }
 
 /* Attempt to reclaim unused space in UDP receive queues */
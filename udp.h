@@ -50,14 +50,29 @@ struct udp {
  */
 struct udp_cb {
 	struct udp_cb *next;
+	struct udp_cb *hnext;	/* Port hash chain pointer */
 	struct socket socket;	/* Local port accepting datagrams */
 	void (*r_upcall)(struct iface *iface,struct udp_cb *,int);
 				/* Function to call when one arrives */
 	struct mbuf *rcvq;	/* Queue of pending datagrams */
 	int rcvcnt;		/* Count of pending datagrams */
+	int rcvlimit;		/* Most datagrams queued; 0 = no limit */
+	int32 drops;		/* Datagrams dropped on full queue */
 	int user;		/* User link */
 };
-extern struct udp_cb *Udps;	/* Hash table for UDP structures */
+extern struct udp_cb *Udps;	/* List of all UDP control blocks */
+
+/* Control blocks are also hashed on local port number. A chain holds
+ * both exact (address, port) and wildcard (INADDR_ANY, port) entries;
+ * an exact match is preferred
+ */
+#define	UDPHASH		32	/* Chains in port hash table, power of 2 */
+#define	udphash(port)	(((port) ^ ((port) >> 5) ^ ((port) >> 10)) & (UDPHASH-1))
+extern struct udp_cb *Udptab[];
+extern int Udp_qlimit;		/* Default rcvlimit for new control blocks */
+extern int32 Udplookups;	/* Calls to lookup_udp() */
+extern int32 Udpprobes;		/* Hash chain entries examined by same */
+extern int32 Udpqdrops;		/* Datagrams dropped on full queues */
 
 /* UDP primitives */
 
@@ -7,12 +7,22 @@
 #include "netuser.h"
 #include "udp.h"
 #include "internet.h"
+#include "timer.h"
+#include "socket.h"
+#include "usock.h"
 #include "cmdparse.h"
 #include "commands.h"
 
+#define	UBMAX	32	/* Largest batch for "udp bench" */
+#define	UBSIZE	64	/* Bytes per datagram for same */
+
+static int doudpbench(int argc,char *argv[],void *p);
+static int doudpqlimit(int argc,char *argv[],void *p);
 static int doudpstat(int argc,char *argv[],void *p);
 
 static struct cmds Udpcmds[] = {
+	"bench",	doudpbench,	0, 0,	NULL,
+	"qlimit",	doudpqlimit,	0, 0,	NULL,
 	"status",	doudpstat,	0, 0,	NULL,
 	NULL,
 };
@@ -30,11 +40,115 @@ struct udp_cb *udp;
 int n;
 {
 	if(n == 0)
-		printf("&UCB      Rcv-Q  Local socket\n");
+		printf("&UCB      Rcv-Q Limit    Drops  Local socket\n");
 
-	return printf("%9p%6u  %s\n",udp,udp->rcvcnt,pinet(&udp->socket));
+	return printf("%9p%6u%6u%9lu  %s\n",udp,udp->rcvcnt,udp->rcvlimit,
+	 udp->drops,pinet(&udp->socket));
+}
+/* Show or set the default receive queue limit for new control blocks,
+ * or set it for those already bound to a port:
+ * "udp qlimit [<n>]" or "udp qlimit <port> <n>"
+ */
+static int
+doudpqlimit(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	register struct udp_cb *udp;
+	uint16 port;
+	int limit;
+
+	if(argc < 3)
+		return setint(&Udp_qlimit,"UDP receive queue limit",argc,argv);
+	port = atoi(argv[1]);
+	limit = atoi(argv[2]);
+	for(udp = Udptab[udphash(port)];udp != NULL;udp = udp->hnext){
+		if(udp->socket.port == port)
+			udp->rcvlimit = limit;
+	}
+	return 0;
 }
 
+/* Time datagrams sent to ourselves, first with one send_mbuf() and
+ * recv_mbuf() per datagram and then in batches with send_mmsg() and
+ * recv_mmsg(): "udp bench [<count> [<batch>]]"
+ */
+static int
+doudpbench(argc,argv,p)
+int argc;
+char *argv[];
+void *p;
+{
+	struct sockaddr_in sock;
+	struct mmsg msgs[UBMAX];
+	struct mbuf *bp;
+	int32 count,i,start,ms[2];
+	int batch,s,n,j,k,got,pass;
+
+	count = argc > 1 ? atol(argv[1]) : 1000L;
+	batch = argc > 2 ? atoi(argv[2]) : 8;
+	if(count <= 0 || batch <= 0)
+		return 1;
+	/* Stay under the receive queue limit, or datagrams get dropped */
+	batch = min(batch,min(UBMAX,Udp_qlimit));
+	if(Ip_addr == 0){
+		printf("IP address not set\n");
+		return 1;
+	}
+	s = socket(AF_INET,SOCK_DGRAM,0);
+	sock.sin_family = AF_INET;
+	sock.sin_addr.s_addr = INADDR_ANY;
+	sock.sin_port = Lport++;
+	bind(s,(struct sockaddr *)&sock,SOCKSIZE);
+	sock.sin_addr.s_addr = Ip_addr;
+
+	kalarm(10000L);	/* In case any are lost */
+	for(pass=0;pass<2;pass++){
+		start = msclock();
+		for(i=0;i<count;i += n){
+			n = (int)min(count - i,(int32)batch);
+			for(j=0;j<n;j++){
+				bp = ambufw(UBSIZE);
+				bp->cnt = UBSIZE;
+				if(pass == 0){
+					send_mbuf(s,&bp,0,(struct sockaddr *)&sock,
+					 SOCKSIZE);
+				} else {
+					msgs[j].bp = bp;
+					memcpy(&msgs[j].name,&sock,SOCKSIZE);
+					msgs[j].namelen = SOCKSIZE;
+				}
+			}
+			if(pass != 0 && send_mmsg(s,msgs,n,0) != n)
+				goto quit;
+			for(j=0;j<n;j += got){
+				if(pass == 0){
+					if(recv_mbuf(s,&bp,0,NULL,NULL) == -1)
+						goto quit;
+					free_p(&bp);
+					got = 1;
+				} else {
+					if((got = recv_mmsg(s,msgs,n-j,0)) == -1)
+						goto quit;
+					for(k=0;k<got;k++)
+						free_p(&msgs[k].bp);
+				}
+			}
+		}
+		ms[pass] = msclock() - start;
+	}
+	kalarm(0L);
+	close_s(s);
+	printf("%lu datagrams, batch %d: mbuf %lu ms, mmsg %lu ms\n",
+	 count,batch,ms[0],ms[1]);
+	return 0;
+quit:
+	kalarm(0L);
+	printf("Bench failed, errno %d\n",errno);
+	close_s(s);
+	return 1;
+}
 /* Dump UDP statistics and control blocks */
 static int
 doudpstat(argc,argv,p)
@@ -44,7 +158,18 @@ void *p;
 {
 	register struct udp_cb *udp;
 	register int i;
+	uint16 port;
 
+	if(argc > 1){
+		/* Just the control blocks on one port, from the hash index */
+		port = atoi(argv[1]);
+		printf("    &UCB Rcv-Q Limit    Drops  Local socket\n");
+		for(udp = Udptab[udphash(port)];udp != NULL;udp = udp->hnext){
+			if(udp->socket.port == port && st_udp(udp,1) == EOF)
+				return 0;
+		}
+		return 0;
+	}
 	for(i=1;i<=NUMUDPMIB;i++){
 		printf("(%2u)%-20s%10lu",i,
 		 Udp_mib[i].name,Udp_mib[i].value.integer);
@@ -55,8 +180,12 @@ void *p;
 	}
 	if((i % 2) == 0)
 		printf("\n");
+	printf("Queue drops %lu, lookups %lu, probes %lu (%lu.%02lu/lookup)\n",
+	 Udpqdrops,Udplookups,Udpprobes,
+	 Udplookups != 0 ? Udpprobes/Udplookups : 0,
+	 Udplookups != 0 ? (Udpprobes % Udplookups)*100/Udplookups : 0);
 
-	printf("    &UCB Rcv-Q  Local socket\n");
+	printf("    &UCB Rcv-Q Limit    Drops  Local socket\n");
 	for(udp = Udps;udp != NULL; udp = udp->next){
 		if(st_udp(udp,1) == EOF)
 			return 0;